@@ -1,7 +1,17 @@
 #version 450
 
+// specialization constant (see DebugColoring in src/vkTutorial.h): 0 solid, 1 normals
+layout(constant_id = 2) const uint DEBUG_COLORING = 0;
+
+layout(location = 0) in vec3 fragNormal;
+
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(1.0f, 1.0f, 0.0f, 1.0f);
+    if (DEBUG_COLORING == 1) {
+        // missing normals are zero, so they aren't normalized
+        outColor = vec4(fragNormal * 0.5 + 0.5, 1.0);
+    } else {
+        outColor = vec4(1.0f, 1.0f, 0.0f, 1.0f);
+    }
 }
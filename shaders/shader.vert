@@ -1,13 +1,66 @@
 #version 450
 
+// specialization constants (see BuildGraphicsPipeline() in src/vulkan.c), the branches are compiled out
+// quantized vertices (VKT_VERTEX_FORMAT=quantized) carry octahedral normals
+layout(constant_id = 0) const bool DEQUANTIZE = false;
+// columns of the instance grid (--instances), 0 for a single instance
+layout(constant_id = 1) const uint INSTANCE_COLUMNS = 0;
+// combined matrix in push constants (--push-constants), the uniform buffer only holds the per frame camera
+layout(constant_id = 3) const bool PUSH_CONSTANTS = false;
+
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+// see PushConstants in src/vulkan.c
+layout(push_constant) uniform PushConstants {
+    mat4 mvp;
+    // clip space offsets between neighbouring copies of the instance grid
+    vec4 instanceStepX;
+    vec4 instanceStepY;
+} pc;
+
 layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+layout(location = 0) out vec3 fragNormal;
+// the depth prepass and the shading pass are separate pipelines, the equal depth test needs identical depths
+invariant gl_Position;
+
+// inverse of encodeOctahedral() in src/mesh.c
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+// grid position of the instance, centered at the origin
+vec2 instanceCell() {
+    uint instance = uint(gl_InstanceIndex);
+    return vec2(instance % INSTANCE_COLUMNS, instance / INSTANCE_COLUMNS) - 0.5 * float(INSTANCE_COLUMNS - 1);
+}
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(pos, 1.0);
+    fragNormal = DEQUANTIZE ? decodeOctahedral(normal.xy) : normal;
+    if (PUSH_CONSTANTS) {
+        // the grid scale is part of mvp
+        gl_Position = pc.mvp * vec4(pos, 1.0);
+        if (INSTANCE_COLUMNS > 0) {
+            vec2 cell = instanceCell();
+            gl_Position += cell.x * pc.instanceStepX + cell.y * pc.instanceStepY;
+        }
+        return;
+    }
+    vec4 position = ubo.model * vec4(pos, 1.0);
+    if (INSTANCE_COLUMNS > 0) {
+        // scaled down copies in a grid
+        position.xyz /= float(INSTANCE_COLUMNS);
+        position.xy += instanceCell() * 2.0 / float(INSTANCE_COLUMNS);
+    }
+    gl_Position = ubo.proj * ubo.view * position;
 }
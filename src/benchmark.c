@@ -0,0 +1,236 @@
+// Benchmark (--benchmark or VKT_BENCHMARK=1): loads every model in models/ in turn, renders --warmup frames and measures
+// the next --frames frames. Results are written as CSV, or as JSON if the --benchmark-output file ends with .json.
+#include "vk.h"
+#include "vkTutorial.h"
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCHMARK_MODELS_DIR "models"
+
+extern GLFWwindow *window;
+extern uint64_t headlessFrame;
+extern uint32_t framesInFlight;
+
+typedef struct {
+  gchar *model;
+  // state of the mesh cache for the measured load: warm, cold or none
+  const char *meshCache;
+  uint32_t numVertices;
+  uint32_t numIndices;
+  // buffer sizes in the vertex format of the pipeline
+  size_t vertexBytes;
+  size_t indexBytes;
+  double loadTime;
+  double uploadTime;
+  // CPU frame times (ms)
+  double mean;
+  double p50;
+  double p95;
+  double p99;
+  // GPU render pass time (ms), negative without timestamp support
+  double gpuTime;
+  // per frame average with --pipeline-stats
+  bool hasStatistics;
+  PipelineStatistics statistics;
+} BenchmarkResult;
+
+static int compareStrings(const void *a, const void *b) { return strcmp(*(const char **)a, *(const char **)b); }
+
+static int compareTimes(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// sorted file names of the OBJ models, null terminated
+static gchar **findModels() {
+  GError *error = nullptr;
+  GDir *dir = g_dir_open(BENCHMARK_MODELS_DIR, 0, &error);
+  if (!dir) {
+    fprintf(stderr, "%s\n", error->message);
+    exit(EXIT_FAILURE);
+  }
+  GPtrArray *models = g_ptr_array_new();
+  const gchar *name;
+  while ((name = g_dir_read_name(dir))) {
+    if (g_str_has_suffix(name, ".obj")) {
+      g_ptr_array_add(models, g_build_filename(BENCHMARK_MODELS_DIR, name, nullptr));
+    }
+  }
+  g_dir_close(dir);
+  qsort(models->pdata, models->len, sizeof(gpointer), compareStrings);
+  g_ptr_array_add(models, nullptr);
+  return (gchar **)g_ptr_array_free(models, FALSE);
+}
+
+// nearest rank percentile of sorted frame times
+static double percentile(const double *sortedTimes, uint32_t count, double p) {
+  uint32_t rank = (uint32_t)ceil(p / 100.0 * count);
+  return sortedTimes[rank ? rank - 1 : 0];
+}
+
+// reads the queries of all frames in flight
+static void collectQueries() {
+  DeviceWaitIdle();
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    ReadTimestampQueries(i);
+    ReadPipelineStatisticsQuery(i);
+  }
+}
+
+// false if the window was closed
+static bool benchmarkFrame() {
+  if (!options.headless) {
+    glfwPollEvents();
+    if (glfwWindowShouldClose(window)) {
+      return false;
+    }
+  }
+  drawFrame();
+  headlessFrame++;
+  return true;
+}
+
+static bool benchmarkModel(const char *fileName, BenchmarkResult *result) {
+  result->model = g_strdup(fileName);
+  gint64 start = g_get_monotonic_time();
+  Mesh *loadedMesh = LoadModel(fileName);
+  gint64 loaded = g_get_monotonic_time();
+  result->loadTime = (loaded - start) / 1000.0;
+  result->meshCache = loadedMesh->cacheState ? loadedMesh->cacheState : "none";
+  result->numVertices = loadedMesh->numVertices;
+  result->numIndices = loadedMesh->numIndices;
+  size_t vertexSize = loadedMesh->vertexFormat == VERTEX_FORMAT_QUANTIZED ? sizeof(QuantizedVertex) : sizeof(Vertex);
+  result->vertexBytes = loadedMesh->numVertices * vertexSize;
+  result->indexBytes = (size_t)loadedMesh->numIndices * loadedMesh->indexSize;
+
+  // frames of the previous model are finished first, so they don't count as upload time
+  DeviceWaitIdle();
+  loaded = g_get_monotonic_time();
+  SwapInMesh(loadedMesh);
+  WaitUpload(FlushStagingRing());
+  result->uploadTime = (g_get_monotonic_time() - loaded) / 1000.0;
+
+  headlessFrame = 0;
+  for (int i = 0; i < options.warmupFrames; i++) {
+    if (!benchmarkFrame()) {
+      return false;
+    }
+  }
+  collectQueries();
+  ResetGpuTimes();
+  ResetPipelineStatistics();
+  double *frameTimes = malloc(options.frames * sizeof(double));
+  gint64 frameStart = g_get_monotonic_time();
+  double sum = 0.0;
+  for (int i = 0; i < options.frames; i++) {
+    if (!benchmarkFrame()) {
+      free(frameTimes);
+      return false;
+    }
+    gint64 frameEnd = g_get_monotonic_time();
+    frameTimes[i] = (frameEnd - frameStart) / 1000.0;
+    sum += frameTimes[i];
+    frameStart = frameEnd;
+  }
+  collectQueries();
+  result->gpuTime = GpuPassMeanTime(GPU_PASS_RENDER);
+  result->hasStatistics = MeanPipelineStatistics(&result->statistics);
+  qsort(frameTimes, options.frames, sizeof(double), compareTimes);
+  result->mean = sum / options.frames;
+  result->p50 = percentile(frameTimes, options.frames, 50.0);
+  result->p95 = percentile(frameTimes, options.frames, 95.0);
+  result->p99 = percentile(frameTimes, options.frames, 99.0);
+  free(frameTimes);
+  return true;
+}
+
+static void writeCsv(FILE *file, const BenchmarkResult *results, uint32_t count) {
+  fprintf(file, "model,mesh_cache,vertices,indices,vertex_bytes,index_bytes,load_ms,upload_ms,frame_mean_ms,frame_p50_ms,frame_p95_ms,frame_p99_ms,"
+                "gpu_render_ms,input_vertices,input_primitives,vs_invocations,clipping_primitives,fs_invocations\n");
+  for (uint32_t i = 0; i < count; i++) {
+    const BenchmarkResult *r = &results[i];
+    fprintf(file, "%s,%s,%u,%u,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,", r->model, r->meshCache, r->numVertices, r->numIndices, r->vertexBytes,
+            r->indexBytes, r->loadTime, r->uploadTime, r->mean, r->p50, r->p95, r->p99);
+    // empty without timestamp support or pipeline statistics
+    if (r->gpuTime >= 0.0) {
+      fprintf(file, "%.3f", r->gpuTime);
+    }
+    const PipelineStatistics *s = &r->statistics;
+    if (r->hasStatistics) {
+      fprintf(file, ",%llu,%llu,%llu,%llu,%llu\n", (unsigned long long)s->inputVertices, (unsigned long long)s->inputPrimitives,
+              (unsigned long long)s->vertexShaderInvocations, (unsigned long long)s->clippingPrimitives,
+              (unsigned long long)s->fragmentShaderInvocations);
+    } else {
+      fprintf(file, ",,,,,\n");
+    }
+  }
+}
+
+static void writeJson(FILE *file, const BenchmarkResult *results, uint32_t count) {
+  fprintf(file, "{\n  \"frames\": %d,\n  \"warmup_frames\": %d,\n  \"models\": [", options.frames, options.warmupFrames);
+  for (uint32_t i = 0; i < count; i++) {
+    const BenchmarkResult *r = &results[i];
+    fprintf(file, "%s\n    {\"model\": \"%s\", \"mesh_cache\": \"%s\", \"vertices\": %u, \"indices\": %u, ", i ? "," : "", r->model, r->meshCache,
+            r->numVertices, r->numIndices);
+    fprintf(file, "\"vertex_bytes\": %zu, \"index_bytes\": %zu, \"load_ms\": %.3f, \"upload_ms\": %.3f, ", r->vertexBytes, r->indexBytes,
+            r->loadTime, r->uploadTime);
+    fprintf(file, "\"frame_mean_ms\": %.3f, \"frame_p50_ms\": %.3f, \"frame_p95_ms\": %.3f, \"frame_p99_ms\": %.3f, ", r->mean, r->p50, r->p95,
+            r->p99);
+    if (r->gpuTime >= 0.0) {
+      fprintf(file, "\"gpu_render_ms\": %.3f", r->gpuTime);
+    } else {
+      fprintf(file, "\"gpu_render_ms\": null");
+    }
+    const PipelineStatistics *s = &r->statistics;
+    if (r->hasStatistics) {
+      fprintf(file, ", \"input_vertices\": %llu, \"input_primitives\": %llu, \"vs_invocations\": %llu, \"clipping_primitives\": %llu, ",
+              (unsigned long long)s->inputVertices, (unsigned long long)s->inputPrimitives, (unsigned long long)s->vertexShaderInvocations,
+              (unsigned long long)s->clippingPrimitives);
+      fprintf(file, "\"fs_invocations\": %llu", (unsigned long long)s->fragmentShaderInvocations);
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n  ]\n}\n");
+}
+
+static void writeResults(const BenchmarkResult *results, uint32_t count) {
+  FILE *file = options.benchmarkOutput ? fopen(options.benchmarkOutput, "w") : stdout;
+  if (!file) {
+    perror("Couldn't open benchmark output file");
+    exit(EXIT_FAILURE);
+  }
+  if (options.benchmarkOutput && g_str_has_suffix(options.benchmarkOutput, ".json")) {
+    writeJson(file, results, count);
+  } else {
+    writeCsv(file, results, count);
+  }
+  if (file != stdout && fclose(file)) {
+    perror("Couldn't write benchmark output file");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// replaces mainloop(), models are loaded on the render thread so load and upload times can be told apart
+void RunBenchmark() {
+  gchar **models = findModels();
+  uint32_t count = g_strv_length(models);
+  BenchmarkResult *results = g_new0(BenchmarkResult, count);
+  uint32_t finished = 0;
+  for (; finished < count; finished++) {
+    debugPrint("Benchmarking %s…\n", models[finished]);
+    if (!benchmarkModel(models[finished], &results[finished])) {
+      break;
+    }
+  }
+  DeviceWaitIdle();
+  writeResults(results, finished);
+  for (uint32_t i = 0; i < count; i++) {
+    g_free(results[i].model);
+  }
+  g_free(results);
+  g_strfreev(models);
+}
@@ -0,0 +1,124 @@
+// Headless rendering (--headless or VKT_HEADLESS=1): no window, surface or swap chain. Frames are rendered into offscreen
+// color images, one per frame in flight, and copied into host visible readback buffers, e.g. to benchmark and compare
+// renderings on machines without a display (software ICDs like lavapipe are accepted as devices).
+#include "vk.h"
+#include "vkTutorial.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+extern VkResult err;
+extern VkDevice device;
+extern VkImage *swapChainImages;
+extern uint32_t swapChainImagesCount;
+extern VkFormat swapChainImageFormat;
+extern VkExtent2D swapChainExtent;
+extern uint32_t framesInFlight;
+extern uint32_t currentFrame;
+extern Mesh *mesh;
+
+// frames rendered after the model was loaded, the model is animated with this frame count (60 fps)
+uint64_t headlessFrame;
+
+static Allocation *offscreenImagesMemory;
+static VkBuffer *readbackBuffers;
+static Allocation *readbackBuffersMemory;
+
+// replaces the swap chain images, the image index of a frame is its frame in flight
+void CreateOffscreenImages() {
+  VkFormat formatCandidates[] = {VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_B8G8R8A8_SRGB};
+  VkFormatFeatureFlags features = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+  swapChainImageFormat = FindSupportedFormat(formatCandidates, sizeof(formatCandidates) / sizeof(VkFormat), VK_IMAGE_TILING_OPTIMAL, features);
+  swapChainExtent = (VkExtent2D){options.width, options.height};
+  swapChainImagesCount = framesInFlight;
+
+  swapChainImages = malloc(swapChainImagesCount * sizeof(VkImage));
+  offscreenImagesMemory = malloc(swapChainImagesCount * sizeof(Allocation));
+  readbackBuffers = malloc(swapChainImagesCount * sizeof(VkBuffer));
+  readbackBuffersMemory = malloc(swapChainImagesCount * sizeof(Allocation));
+  VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  VkDeviceSize readbackSize = (VkDeviceSize)swapChainExtent.width * swapChainExtent.height * 4;
+  int memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  for (int i = 0; i < swapChainImagesCount; i++) {
+    CreateImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, imageUsage,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &swapChainImages[i], &offscreenImagesMemory[i]);
+    // cached memory makes reading the frames on the CPU fast
+    CreateBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &readbackBuffers[i],
+                 &readbackBuffersMemory[i]);
+  }
+  debugPrint("Offscreen images: %u (%ux%u)\n", swapChainImagesCount, swapChainExtent.width, swapChainExtent.height);
+}
+
+// recorded after the render pass, which leaves the image in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL (see CreateRenderPass())
+void RecordReadback(VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
+  VkBufferImageCopy region = {
+      .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .imageSubresource.layerCount = 1,
+      .imageExtent = {swapChainExtent.width, swapChainExtent.height, 1},
+  };
+  vkCmdCopyImageToBuffer(cmdBuffer, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[imageIndex], 1, &region);
+
+  // the in flight fence makes the frame visible to the host
+  VkBufferMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = readbackBuffers[imageIndex],
+      .size = VK_WHOLE_SIZE,
+  };
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+// returns the pixels of the frame rendered into the image, valid once its in flight fence is signaled
+const uint8_t *ReadbackFrame(uint32_t imageIndex) { return readbackBuffersMemory[imageIndex].mapped; }
+
+void DestroyOffscreenImages() {
+  for (int i = 0; i < swapChainImagesCount; i++) {
+    vkDestroyImage(device, swapChainImages[i], nullptr);
+    FreeMemory(&offscreenImagesMemory[i]);
+    vkDestroyBuffer(device, readbackBuffers[i], nullptr);
+    FreeMemory(&readbackBuffersMemory[i]);
+  }
+  free(swapChainImages);
+  free(offscreenImagesMemory);
+  free(readbackBuffers);
+  free(readbackBuffersMemory);
+}
+
+// binary PPM, the alpha channel is dropped
+static void writePPM(const char *fileName, const uint8_t *pixels) {
+  FILE *file = fopen(fileName, "wb");
+  if (!file) {
+    perror("Couldn't open output file");
+    exit(EXIT_FAILURE);
+  }
+  bool bgra = swapChainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+  fprintf(file, "P6\n%u %u\n255\n", swapChainExtent.width, swapChainExtent.height);
+  for (size_t i = 0; i < (size_t)swapChainExtent.width * swapChainExtent.height; i++) {
+    const uint8_t *pixel = &pixels[i * 4];
+    uint8_t rgb[] = {pixel[bgra ? 2 : 0], pixel[1], pixel[bgra ? 0 : 2]};
+    fwrite(rgb, 1, sizeof(rgb), file);
+  }
+  if (fclose(file)) {
+    perror("Couldn't write output file");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Renders --frames frames of the loaded model and writes the last one to --output. Frames drawn while the model is
+// loading aren't counted, so the output doesn't depend on the loading time.
+void RenderHeadless() {
+  while (!mesh) {
+    drawFrame();
+  }
+  for (headlessFrame = 0; headlessFrame < options.frames; headlessFrame++) {
+    drawFrame();
+  }
+  DeviceWaitIdle();
+  if (options.output) {
+    uint32_t lastFrame = (currentFrame + framesInFlight - 1) % framesInFlight;
+    writePPM(options.output, ReadbackFrame(lastFrame));
+    debugPrint("Frame written to %s\n", options.output);
+  }
+}
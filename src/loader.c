@@ -0,0 +1,69 @@
+// Loads models on a background thread while the render loop is already presenting frames. Loaded meshes are handed
+// to the render loop through a lock-free single producer, single consumer queue.
+#include "vk.h"
+#include "vkTutorial.h"
+#include <glib.h>
+#include <stdatomic.h>
+
+#define LOADED_MESH_QUEUE_SIZE 8
+
+static Mesh *loadedMeshes[LOADED_MESH_QUEUE_SIZE];
+// advanced by the loader thread only
+static atomic_uint loadedMeshesTail;
+// advanced by the render loop only
+static atomic_uint loadedMeshesHead;
+static atomic_bool stopLoading;
+static GThread *loaderThread;
+static gchar **loaderFiles;
+
+static gpointer loadModels(gpointer data) {
+  for (gchar **fileName = loaderFiles; *fileName && !atomic_load(&stopLoading); fileName++) {
+    Mesh *mesh = LoadModel(*fileName);
+    unsigned tail = atomic_load_explicit(&loadedMeshesTail, memory_order_relaxed);
+    // the render loop drains the queue every frame
+    while (tail - atomic_load_explicit(&loadedMeshesHead, memory_order_acquire) == LOADED_MESH_QUEUE_SIZE) {
+      if (atomic_load(&stopLoading)) {
+        FreeMesh(mesh);
+        return nullptr;
+      }
+      g_usleep(1000);
+    }
+    loadedMeshes[tail % LOADED_MESH_QUEUE_SIZE] = mesh;
+    atomic_store_explicit(&loadedMeshesTail, tail + 1, memory_order_release);
+  }
+  return nullptr;
+}
+
+// loads the models of the null terminated list in order
+void StartModelLoader(const char *const *fileNames) {
+  loaderFiles = g_strdupv((gchar **)fileNames);
+  atomic_store(&stopLoading, false);
+  loaderThread = g_thread_new("model loader", loadModels, nullptr);
+}
+
+// returns the next loaded mesh or nullptr, called by the render loop
+Mesh *PollLoadedMesh(void) {
+  unsigned head = atomic_load_explicit(&loadedMeshesHead, memory_order_relaxed);
+  if (head == atomic_load_explicit(&loadedMeshesTail, memory_order_acquire)) {
+    return nullptr;
+  }
+  Mesh *mesh = loadedMeshes[head % LOADED_MESH_QUEUE_SIZE];
+  atomic_store_explicit(&loadedMeshesHead, head + 1, memory_order_release);
+  return mesh;
+}
+
+// a model being parsed is finished first, meshes not taken by the render loop are freed
+void StopModelLoader(void) {
+  if (!loaderThread) {
+    return;
+  }
+  atomic_store(&stopLoading, true);
+  g_thread_join(loaderThread);
+  loaderThread = nullptr;
+  Mesh *mesh;
+  while ((mesh = PollLoadedMesh())) {
+    FreeMesh(mesh);
+  }
+  g_strfreev(loaderFiles);
+  loaderFiles = nullptr;
+}
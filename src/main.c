@@ -1,9 +1,20 @@
 #include "vkTutorial.h"
 
-int main(void) {
-  initGLFW();
+int main(int argc, char *argv[]) {
+  ParseOptions(&argc, &argv);
+  if (!options.headless) {
+    initGLFW();
+  }
   initVulkan();
-  mainloop();
+  if (options.benchmark) {
+    RunBenchmark();
+  } else if (options.headless) {
+    RenderHeadless();
+  } else {
+    mainloop();
+  }
   cleanupVulkan();
-  cleanupGLFW();
+  if (!options.headless) {
+    cleanupGLFW();
+  }
 }
@@ -0,0 +1,359 @@
+// Device memory sub-allocator. Large VkDeviceMemory blocks are allocated per memory type and handed out with a
+// buddy allocator (power of two sized, naturally aligned ranges). Buffers and images (linear and optimal resources)
+// are kept in separate pools, so bufferImageGranularity never has to be considered.
+#include "vkTutorial.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern VkPhysicalDevice physicalDevice;
+extern VkDevice device;
+extern VkResult err;
+
+#define MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
+#define MIN_MEMORY_BLOCK_SIZE (1024 * 1024)
+// smallest range handed out
+#define MEMORY_UNIT_ORDER 8
+#define MEMORY_UNIT (1 << MEMORY_UNIT_ORDER)
+
+typedef struct {
+  VkDeviceMemory memory;
+  VkDeviceSize size;
+  void *mapped;
+  // buddy tree: order + 1 of the largest free range below each node, 0 if fully allocated (nullptr for dedicated blocks)
+  uint8_t *longest;
+  uint32_t maxOrder;
+  VkDeviceSize used;
+  VkDeviceSize requested;
+  uint32_t numAllocations;
+} MemoryBlock;
+
+typedef struct {
+  MemoryBlock *blocks;
+  uint32_t numBlocks;
+  VkDeviceSize blockSize;
+} MemoryPool;
+
+// [memory type][linear]
+static MemoryPool pools[VK_MAX_MEMORY_TYPES][2];
+
+// captured once after the physical device is picked
+static VkPhysicalDeviceMemoryProperties memProperties;
+
+// memory types found for (typeBits, required, preferred)
+typedef struct {
+  uint32_t typeBits;
+  VkMemoryPropertyFlags required;
+  VkMemoryPropertyFlags preferred;
+  uint32_t memoryTypeIndex;
+} MemoryTypeEntry;
+
+#define MEMORY_TYPE_TABLE_SIZE 32
+static MemoryTypeEntry memoryTypeTable[MEMORY_TYPE_TABLE_SIZE];
+static uint32_t memoryTypeTableSize;
+
+void InitMemoryTypes(void) {
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+  memoryTypeTableSize = 0;
+  for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+    debugPrint("Memory heap %u: %lu bytes%s\n", i, memProperties.memoryHeaps[i].size,
+               memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? " (device local)" : "");
+  }
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    debugPrint("Memory type %u: heap %u, property flags 0x%x\n", i, memProperties.memoryTypes[i].heapIndex,
+               memProperties.memoryTypes[i].propertyFlags);
+  }
+}
+
+static uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) {
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
+
+// Preferred flags are dropped if no memory type has them, e.g. DEVICE_LOCAL for host visible memory without resizable BAR.
+// Exits program if no memory type has the required flags.
+uint32_t FindMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) {
+  for (uint32_t i = 0; i < memoryTypeTableSize; i++) {
+    const MemoryTypeEntry *entry = &memoryTypeTable[i];
+    if (entry->typeBits == typeBits && entry->required == required && entry->preferred == preferred) {
+      return entry->memoryTypeIndex;
+    }
+  }
+
+  uint32_t memoryTypeIndex = findMemoryType(typeBits, required | preferred);
+  if (memoryTypeIndex == UINT32_MAX) {
+    memoryTypeIndex = findMemoryType(typeBits, required);
+  }
+  if (memoryTypeIndex == UINT32_MAX) {
+    err = VKT_ERROR_NO_SUITABLE_MEMORY_AVAILABLE;
+    handleError();
+  }
+  if (memoryTypeTableSize < MEMORY_TYPE_TABLE_SIZE) {
+    memoryTypeTable[memoryTypeTableSize++] = (MemoryTypeEntry){typeBits, required, preferred, memoryTypeIndex};
+  }
+  return memoryTypeIndex;
+}
+
+static VkDeviceSize poolBlockSize(uint32_t memoryTypeIndex) {
+  VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+  // small heaps (e.g. 256 MiB BAR) get smaller blocks
+  VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+  while (blockSize > MIN_MEMORY_BLOCK_SIZE && blockSize > heapSize / 8) {
+    blockSize /= 2;
+  }
+  return blockSize;
+}
+
+static uint32_t orderOf(VkDeviceSize size) {
+  uint32_t order = 0;
+  while (((VkDeviceSize)MEMORY_UNIT << order) < size) {
+    order++;
+  }
+  return order;
+}
+
+static MemoryBlock *addBlock(MemoryPool *pool, uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated, uint32_t *blockIndex) {
+  // reuse slots of released blocks
+  uint32_t index = 0;
+  while (index < pool->numBlocks && pool->blocks[index].memory) {
+    index++;
+  }
+  if (index == pool->numBlocks) {
+    pool->blocks = realloc(pool->blocks, ++pool->numBlocks * sizeof(MemoryBlock));
+    if (!pool->blocks) {
+      perror("Couldn't allocate memory blocks");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  VkMemoryPriorityAllocateInfoEXT allocInfoExt = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_PRIORITY_ALLOCATE_INFO_EXT,
+      .priority = 1.0f,
+  };
+
+  VkMemoryAllocateInfo allocInfo = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = &allocInfoExt,
+      .allocationSize = size,
+      .memoryTypeIndex = memoryTypeIndex,
+  };
+
+  MemoryBlock *block = &pool->blocks[index];
+  *block = (MemoryBlock){.size = size};
+  err = vkAllocateMemory(device, &allocInfo, nullptr, &block->memory);
+  handleError();
+
+  // host visible blocks stay mapped for their whole lifetime
+  if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    err = vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+    handleError();
+  }
+
+  if (!dedicated) {
+    block->maxOrder = orderOf(size);
+    uint32_t numNodes = (2u << block->maxOrder) - 1;
+    block->longest = malloc(numNodes);
+    if (!block->longest) {
+      perror("Couldn't allocate memory blocks");
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t node = 0, order = block->maxOrder + 1; node < numNodes; order--) {
+      // all nodes of one tree level
+      uint32_t levelEnd = 2 * node + 1;
+      memset(&block->longest[node], order, levelEnd - node);
+      node = levelEnd;
+    }
+  }
+  *blockIndex = index;
+  return block;
+}
+
+// returns the offset in units or UINT32_MAX if the block has no free range of the given order
+static uint32_t buddyAllocate(MemoryBlock *block, uint32_t order) {
+  if (block->longest[0] < order + 1) {
+    return UINT32_MAX;
+  }
+  uint32_t node = 0;
+  uint32_t nodeOrder = block->maxOrder;
+  for (; nodeOrder > order; nodeOrder--) {
+    uint32_t left = 2 * node + 1;
+    node = block->longest[left] >= order + 1 ? left : left + 1;
+  }
+  block->longest[node] = 0;
+  uint32_t offset = ((node + 1) << nodeOrder) - (1u << block->maxOrder);
+
+  while (node) {
+    node = (node - 1) / 2;
+    uint8_t left = block->longest[2 * node + 1];
+    uint8_t right = block->longest[2 * node + 2];
+    block->longest[node] = left > right ? left : right;
+  }
+  return offset;
+}
+
+// returns the order of the freed range
+static uint32_t buddyFree(MemoryBlock *block, uint32_t offset) {
+  // walk up from the leaf to the allocated node, the nodes below an allocated node are all free
+  uint32_t node = offset + (1u << block->maxOrder) - 1;
+  uint32_t nodeOrder = 0;
+  while (block->longest[node]) {
+    node = (node - 1) / 2;
+    nodeOrder++;
+  }
+  uint32_t order = nodeOrder;
+  block->longest[node] = nodeOrder + 1;
+
+  // merge buddies
+  while (node) {
+    node = (node - 1) / 2;
+    nodeOrder++;
+    uint8_t left = block->longest[2 * node + 1];
+    uint8_t right = block->longest[2 * node + 2];
+    if (left == nodeOrder && right == nodeOrder) {
+      block->longest[node] = nodeOrder + 1;
+    } else {
+      block->longest[node] = left > right ? left : right;
+    }
+  }
+  return order;
+}
+
+static void releaseBlock(MemoryBlock *block) {
+  // vkFreeMemory unmaps implicitly
+  vkFreeMemory(device, block->memory, nullptr);
+  free(block->longest);
+  *block = (MemoryBlock){};
+}
+
+Allocation AllocateMemory(VkMemoryRequirements requirements, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, bool linear) {
+  uint32_t memoryTypeIndex = FindMemoryTypeIndex(requirements.memoryTypeBits, required, preferred);
+  MemoryPool *pool = &pools[memoryTypeIndex][linear];
+  if (!pool->blockSize) {
+    pool->blockSize = poolBlockSize(memoryTypeIndex);
+  }
+
+  Allocation allocation = {
+      .memoryTypeIndex = memoryTypeIndex,
+      .linear = linear,
+  };
+  VkDeviceSize size = requirements.size > requirements.alignment ? requirements.size : requirements.alignment;
+
+  // resources larger than a block get their own VkDeviceMemory
+  if (size > pool->blockSize) {
+    MemoryBlock *block = addBlock(pool, memoryTypeIndex, requirements.size, true, &allocation.block);
+    block->used = block->requested = requirements.size;
+    block->numAllocations = 1;
+    allocation.memory = block->memory;
+    allocation.size = requirements.size;
+    allocation.mapped = block->mapped;
+    return allocation;
+  }
+
+  uint32_t order = orderOf(size);
+  uint32_t offset = UINT32_MAX;
+  MemoryBlock *block = nullptr;
+  for (uint32_t i = 0; i < pool->numBlocks && offset == UINT32_MAX; i++) {
+    block = &pool->blocks[i];
+    if (block->memory && block->longest) {
+      offset = buddyAllocate(block, order);
+      allocation.block = i;
+    }
+  }
+  if (offset == UINT32_MAX) {
+    block = addBlock(pool, memoryTypeIndex, pool->blockSize, false, &allocation.block);
+    offset = buddyAllocate(block, order);
+  }
+
+  allocation.memory = block->memory;
+  allocation.offset = (VkDeviceSize)offset * MEMORY_UNIT;
+  allocation.size = requirements.size;
+  allocation.mapped = block->mapped ? (char *)block->mapped + allocation.offset : nullptr;
+  block->used += (VkDeviceSize)MEMORY_UNIT << order;
+  block->requested += requirements.size;
+  block->numAllocations++;
+  return allocation;
+}
+
+void FreeMemory(Allocation *allocation) {
+  if (!allocation->memory) {
+    return;
+  }
+  MemoryPool *pool = &pools[allocation->memoryTypeIndex][allocation->linear];
+  MemoryBlock *block = &pool->blocks[allocation->block];
+  if (block->longest) {
+    uint32_t order = buddyFree(block, allocation->offset / MEMORY_UNIT);
+    block->used -= (VkDeviceSize)MEMORY_UNIT << order;
+    block->requested -= allocation->size;
+  }
+  // keep the first block of a pool around, later allocations would need it again
+  if (--block->numAllocations == 0 && (!block->longest || allocation->block > 0)) {
+    releaseBlock(block);
+  }
+  *allocation = (Allocation){};
+}
+
+// free bytes and the largest free range of a block
+static void freeRanges(const MemoryBlock *block, VkDeviceSize *freeBytes, VkDeviceSize *largestFree) {
+  *freeBytes = block->size - block->used;
+  *largestFree = block->longest && block->longest[0] ? (VkDeviceSize)MEMORY_UNIT << (block->longest[0] - 1) : 0;
+}
+
+void PrintMemoryStats(void) {
+  debugPrint("Device memory:\n");
+  for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+    for (int linear = 0; linear < 2; linear++) {
+      const MemoryPool *pool = &pools[type][linear];
+      uint32_t numBlocks = 0;
+      uint32_t numAllocations = 0;
+      VkDeviceSize size = 0;
+      VkDeviceSize used = 0;
+      VkDeviceSize requested = 0;
+      VkDeviceSize freeBytes = 0;
+      VkDeviceSize largestFree = 0;
+      for (uint32_t i = 0; i < pool->numBlocks; i++) {
+        const MemoryBlock *block = &pool->blocks[i];
+        if (!block->memory) {
+          continue;
+        }
+        VkDeviceSize blockFree;
+        VkDeviceSize blockLargestFree;
+        freeRanges(block, &blockFree, &blockLargestFree);
+        numBlocks++;
+        numAllocations += block->numAllocations;
+        size += block->size;
+        used += block->used;
+        requested += block->requested;
+        freeBytes += blockFree;
+        largestFree = blockLargestFree > largestFree ? blockLargestFree : largestFree;
+      }
+      if (!numBlocks) {
+        continue;
+      }
+      // internal: padding of ranges to powers of two, external: free memory not usable by the largest possible request
+      double internal = used ? 1.0 - (double)requested / used : 0.0;
+      double external = freeBytes ? 1.0 - (double)largestFree / freeBytes : 0.0;
+      debugPrint("  type %u (%s): %u blocks, %lu bytes, %u allocations, %lu bytes used (%lu requested), fragmentation %.1f%% internal, %.1f%% "
+                 "external\n",
+                 type, linear ? "buffers" : "images", numBlocks, size, numAllocations, used, requested, 100.0 * internal, 100.0 * external);
+    }
+  }
+}
+
+void DestroyMemoryAllocator(void) {
+  for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++) {
+    for (int linear = 0; linear < 2; linear++) {
+      MemoryPool *pool = &pools[type][linear];
+      for (uint32_t i = 0; i < pool->numBlocks; i++) {
+        if (pool->blocks[i].memory) {
+          releaseBlock(&pool->blocks[i]);
+        }
+      }
+      free(pool->blocks);
+      *pool = (MemoryPool){};
+    }
+  }
+}
@@ -0,0 +1,627 @@
+// Mesh processing between the OBJ loaders and the vertex/index buffers.
+#include "vk.h"
+#include "vkTutorial.h"
+#include <glib.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  float x;
+  float y;
+} Point2D;
+
+static inline float cross2D(Point2D a, Point2D b, Point2D c) { return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x); }
+
+// barycentric sign test, points on an edge count as inside
+static inline bool insideTriangle(Point2D p, Point2D a, Point2D b, Point2D c, float orientation) {
+  return cross2D(a, b, p) * orientation >= 0.0f && cross2D(b, c, p) * orientation >= 0.0f && cross2D(c, a, p) * orientation >= 0.0f;
+}
+
+// Projects the polygon onto the coordinate plane most perpendicular to its (Newell) normal.
+// Returns the signed area of the projection: > 0 counterclockwise, < 0 clockwise.
+static float projectPolygon(const vec3 *positions, const ObjIndex *face, uint32_t n, Point2D *points) {
+  float normal[3] = {};
+  for (uint32_t i = 0; i < n; i++) {
+    const float *a = positions[face[i].pos];
+    const float *b = positions[face[(i + 1) % n].pos];
+    normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+    normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+    normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+  }
+  float ax = normal[0] < 0 ? -normal[0] : normal[0];
+  float ay = normal[1] < 0 ? -normal[1] : normal[1];
+  float az = normal[2] < 0 ? -normal[2] : normal[2];
+  int u = ax >= ay && ax >= az ? 1 : 0;
+  int v = ax >= ay && ax >= az ? 2 : ay >= az ? 2 : 1;
+
+  float area = 0.0f;
+  for (uint32_t i = 0; i < n; i++) {
+    points[i] = (Point2D){positions[face[i].pos][u], positions[face[i].pos][v]};
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    Point2D a = points[i];
+    Point2D b = points[(i + 1) % n];
+    area += a.x * b.y - b.x * a.y;
+  }
+  return area;
+}
+
+static bool isConvex(const Point2D *points, uint32_t n, float orientation) {
+  for (uint32_t i = 0; i < n; i++) {
+    if (cross2D(points[i], points[(i + 1) % n], points[(i + 2) % n]) * orientation < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Ear clipping, O(n²). Always emits n - 2 triangles: if no ear is found (degenerate or self
+// intersecting polygon) the current corner is clipped anyway.
+static uint32_t *earClip(uint32_t face, uint32_t n, const Point2D *points, float orientation, uint32_t *ring, uint32_t *out) {
+  for (uint32_t i = 0; i < n; i++) {
+    ring[i] = i;
+  }
+  uint32_t remaining = n;
+  uint32_t i = 0;
+  uint32_t misses = 0;
+  while (remaining > 3) {
+    uint32_t prev = ring[(i + remaining - 1) % remaining];
+    uint32_t cur = ring[i];
+    uint32_t next = ring[(i + 1) % remaining];
+    bool ear = cross2D(points[prev], points[cur], points[next]) * orientation > 0.0f;
+    for (uint32_t k = 0; ear && k < remaining; k++) {
+      uint32_t other = ring[k];
+      if (other != prev && other != cur && other != next) {
+        ear = !insideTriangle(points[other], points[prev], points[cur], points[next], orientation);
+      }
+    }
+    if (ear || misses > remaining) {
+      *out++ = face + prev;
+      *out++ = face + cur;
+      *out++ = face + next;
+      memmove(&ring[i], &ring[i + 1], (remaining - i - 1) * sizeof(uint32_t));
+      remaining--;
+      i = i % remaining;
+      misses = 0;
+    } else {
+      i = (i + 1) % remaining;
+      misses++;
+    }
+  }
+  *out++ = face + ring[0];
+  *out++ = face + ring[1];
+  *out++ = face + ring[2];
+  return out;
+}
+
+// Returns a triangle list of corner indices (positions in corners).
+uint32_t *TriangulateFaces(const vec3 *positions, const ObjIndex *corners, const uint32_t *faceSizes, uint32_t numFaces,
+                           uint32_t *numTriangleCorners) {
+  // size output and scratch space up front from the face arity
+  size_t total = 0;
+  uint32_t maxFaceSize = 0;
+  for (uint32_t f = 0; f < numFaces; f++) {
+    total += faceSizes[f] >= 3 ? 3 * (faceSizes[f] - 2) : 0;
+    maxFaceSize = faceSizes[f] > maxFaceSize ? faceSizes[f] : maxFaceSize;
+  }
+  uint32_t *triangles = malloc(total * sizeof(uint32_t));
+  Point2D *points = malloc(maxFaceSize * sizeof(Point2D));
+  uint32_t *ring = malloc(maxFaceSize * sizeof(uint32_t));
+  if (!triangles || (maxFaceSize && (!points || !ring))) {
+    perror("Couldn't allocate triangle indices");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t *out = triangles;
+  uint32_t face = 0;
+  for (uint32_t f = 0; f < numFaces; face += faceSizes[f++]) {
+    uint32_t n = faceSizes[f];
+    if (n < 3) {
+      // points and lines
+      continue;
+    }
+    if (n > 3) {
+      float orientation = projectPolygon(positions, &corners[face], n, points) < 0.0f ? -1.0f : 1.0f;
+      if (!isConvex(points, n, orientation)) {
+        out = earClip(face, n, points, orientation, ring, out);
+        continue;
+      }
+    }
+    // triangle fan
+    for (uint32_t i = 1; i + 1 < n; i++) {
+      *out++ = face;
+      *out++ = face + i;
+      *out++ = face + i + 1;
+    }
+  }
+
+  free(points);
+  free(ring);
+  *numTriangleCorners = total;
+  return triangles;
+}
+
+static inline uint32_t hashObjIndex(ObjIndex key) {
+  uint32_t h = key.pos * 0x9e3779b1u ^ key.texCoord * 0x85ebca77u ^ key.normal * 0xc2b2ae3du;
+  return h ^ (h >> 15);
+}
+
+// Creates one vertex per distinct (v, vt, vn) tuple, using an open addressing hash table (linear probing)
+// keyed on the tuple. indices holds corner indices on input and vertex indices on output.
+Vertex *BuildVertices(const vec3 *positions, const vec2 *texCoords, const vec3 *normals, const ObjIndex *corners, uint32_t *indices,
+                      uint32_t numIndices, uint32_t *numVertices) {
+  // at most numIndices distinct tuples, load factor <= 0.5
+  uint32_t capacity = 16;
+  while (capacity < 2 * (uint64_t)numIndices) {
+    capacity *= 2;
+  }
+  uint32_t *table = malloc(capacity * sizeof(uint32_t));
+  ObjIndex *keys = malloc(numIndices * sizeof(ObjIndex));
+  Vertex *vertices = malloc(numIndices * sizeof(Vertex));
+  if (!table || (numIndices && (!keys || !vertices))) {
+    perror("Couldn't allocate vertices");
+    exit(EXIT_FAILURE);
+  }
+  memset(table, 0xff, capacity * sizeof(uint32_t));
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < numIndices; i++) {
+    ObjIndex key = corners[indices[i]];
+    uint32_t slot = hashObjIndex(key) & (capacity - 1);
+    while (table[slot] != UINT32_MAX) {
+      ObjIndex other = keys[table[slot]];
+      if (other.pos == key.pos && other.texCoord == key.texCoord && other.normal == key.normal) {
+        break;
+      }
+      slot = (slot + 1) & (capacity - 1);
+    }
+    if (table[slot] == UINT32_MAX) {
+      Vertex *v = &vertices[count];
+      memcpy(v->pos, positions[key.pos], sizeof(vec3));
+      if (key.normal != OBJ_INDEX_NONE) {
+        memcpy(v->normal, normals[key.normal], sizeof(vec3));
+      } else {
+        memset(v->normal, 0, sizeof(vec3));
+      }
+      if (key.texCoord != OBJ_INDEX_NONE) {
+        memcpy(v->texCoord, texCoords[key.texCoord], sizeof(vec2));
+      } else {
+        memset(v->texCoord, 0, sizeof(vec2));
+      }
+      keys[count] = key;
+      table[slot] = count++;
+    }
+    indices[i] = table[slot];
+  }
+
+  free(table);
+  free(keys);
+  *numVertices = count;
+  return realloc(vertices, (count ? count : 1) * sizeof(Vertex));
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation". Greedily emits the triangle with the highest score,
+// scoring vertices by their position in a simulated LRU cache and by how many triangles still use them.
+#define VERTEX_CACHE_SIZE 32
+
+static float vertexScore(int32_t cachePosition, uint32_t remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    // the last triangle's vertices are scored low on purpose, so that the next triangle isn't a strip continuation only
+    score = cachePosition < 3 ? 0.75f : powf(1.0f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+  }
+  return score + 2.0f / sqrtf((float)remainingTriangles);
+}
+
+static void optimizeVertexCache(uint32_t *indices, uint32_t numIndices, uint32_t numVertices) {
+  uint32_t numTriangles = numIndices / 3;
+  uint32_t *remaining = calloc(numVertices, sizeof(uint32_t));
+  uint32_t *offsets = malloc((numVertices + 1) * sizeof(uint32_t));
+  uint32_t *adjacency = malloc(numIndices * sizeof(uint32_t));
+  int32_t *cachePositions = malloc(numVertices * sizeof(int32_t));
+  float *vertexScores = malloc(numVertices * sizeof(float));
+  float *triangleScores = malloc(numTriangles * sizeof(float));
+  bool *emitted = calloc(numTriangles, sizeof(bool));
+  uint32_t *out = malloc(numIndices * sizeof(uint32_t));
+  if (!remaining || !offsets || !adjacency || !cachePositions || !vertexScores || !triangleScores || !emitted || !out) {
+    perror("Couldn't allocate vertex cache optimizer");
+    exit(EXIT_FAILURE);
+  }
+
+  // vertex → triangles adjacency; remaining[v] is the number of triangles not yet emitted
+  for (uint32_t i = 0; i < numIndices; i++) {
+    remaining[indices[i]]++;
+  }
+  offsets[0] = 0;
+  for (uint32_t v = 0; v < numVertices; v++) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+    remaining[v] = 0;
+  }
+  for (uint32_t i = 0; i < numIndices; i++) {
+    uint32_t v = indices[i];
+    adjacency[offsets[v] + remaining[v]++] = i / 3;
+  }
+  for (uint32_t v = 0; v < numVertices; v++) {
+    cachePositions[v] = -1;
+    vertexScores[v] = vertexScore(-1, remaining[v]);
+  }
+  uint32_t best = UINT32_MAX;
+  for (uint32_t t = 0; t < numTriangles; t++) {
+    const uint32_t *tri = &indices[3 * t];
+    triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+    if (best == UINT32_MAX || triangleScores[t] > triangleScores[best]) {
+      best = t;
+    }
+  }
+
+  uint32_t cache[VERTEX_CACHE_SIZE + 3];
+  uint32_t newCache[VERTEX_CACHE_SIZE + 3];
+  uint32_t cacheSize = 0;
+  uint32_t cursor = 0;
+  for (uint32_t emittedTriangles = 0; emittedTriangles < numTriangles; emittedTriangles++) {
+    if (best == UINT32_MAX) {
+      // nothing adjacent to the cache left, continue with the next triangle in input order
+      while (emitted[cursor]) {
+        cursor++;
+      }
+      best = cursor;
+    }
+    const uint32_t *tri = &indices[3 * best];
+    memcpy(&out[3 * emittedTriangles], tri, 3 * sizeof(uint32_t));
+    emitted[best] = true;
+
+    // the emitted triangle no longer counts for its vertices
+    uint32_t newCacheSize = 0;
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = tri[k];
+      uint32_t *list = &adjacency[offsets[v]];
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        if (list[j] == best) {
+          list[j] = list[--remaining[v]];
+          break;
+        }
+      }
+      if (k == 0 || (k == 1 && v != tri[0]) || (k == 2 && v != tri[0] && v != tri[1])) {
+        newCache[newCacheSize++] = v;
+      }
+    }
+    // move the triangle's vertices to the front of the cache
+    for (uint32_t i = 0; i < cacheSize; i++) {
+      uint32_t v = cache[i];
+      if (v != tri[0] && v != tri[1] && v != tri[2]) {
+        newCache[newCacheSize++] = v;
+      }
+    }
+    for (uint32_t i = 0; i < newCacheSize; i++) {
+      uint32_t v = newCache[i];
+      cachePositions[v] = i < VERTEX_CACHE_SIZE ? (int32_t)i : -1;
+      vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+    }
+
+    // rescore triangles touching the cache and pick the next one among them
+    best = UINT32_MAX;
+    float bestScore = 0.0f;
+    for (uint32_t i = 0; i < newCacheSize; i++) {
+      uint32_t v = newCache[i];
+      for (uint32_t j = 0; j < remaining[v]; j++) {
+        uint32_t t = adjacency[offsets[v] + j];
+        const uint32_t *other = &indices[3 * t];
+        triangleScores[t] = vertexScores[other[0]] + vertexScores[other[1]] + vertexScores[other[2]];
+        if (i < VERTEX_CACHE_SIZE && (best == UINT32_MAX || triangleScores[t] > bestScore)) {
+          best = t;
+          bestScore = triangleScores[t];
+        }
+      }
+    }
+    cacheSize = newCacheSize < VERTEX_CACHE_SIZE ? newCacheSize : VERTEX_CACHE_SIZE;
+    memcpy(cache, newCache, cacheSize * sizeof(uint32_t));
+  }
+
+  memcpy(indices, out, numTriangles * 3 * sizeof(uint32_t));
+  free(remaining);
+  free(offsets);
+  free(adjacency);
+  free(cachePositions);
+  free(vertexScores);
+  free(triangleScores);
+  free(emitted);
+  free(out);
+}
+
+// Renumbers vertices in order of first use, so vertex fetches walk the vertex buffer linearly.
+// Returns the number of referenced vertices.
+static uint32_t optimizeVertexFetch(Vertex *vertices, uint32_t numVertices, uint32_t *indices, uint32_t numIndices) {
+  uint32_t *remap = malloc(numVertices * sizeof(uint32_t));
+  Vertex *reordered = malloc(numVertices * sizeof(Vertex));
+  if (numVertices && (!remap || !reordered)) {
+    perror("Couldn't allocate vertex fetch optimizer");
+    exit(EXIT_FAILURE);
+  }
+  memset(remap, 0xff, numVertices * sizeof(uint32_t));
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < numIndices; i++) {
+    uint32_t v = indices[i];
+    if (remap[v] == UINT32_MAX) {
+      reordered[count] = vertices[v];
+      remap[v] = count++;
+    }
+    indices[i] = remap[v];
+  }
+  memcpy(vertices, reordered, count * sizeof(Vertex));
+  free(remap);
+  free(reordered);
+  return count;
+}
+
+// Number of vertex shader invocations with a FIFO post-transform cache of cacheSize entries.
+static uint32_t simulateVertexCache(const uint32_t *indices, uint32_t numIndices, uint32_t numVertices, uint32_t cacheSize) {
+  uint32_t *timestamps = calloc(numVertices, sizeof(uint32_t));
+  if (numVertices && !timestamps) {
+    perror("Couldn't allocate vertex cache simulation");
+    exit(EXIT_FAILURE);
+  }
+  uint32_t time = cacheSize + 1;
+  uint32_t misses = 0;
+  for (uint32_t i = 0; i < numIndices; i++) {
+    uint32_t v = indices[i];
+    if (time - timestamps[v] > cacheSize) {
+      timestamps[v] = time++;
+      misses++;
+    }
+  }
+  free(timestamps);
+  return misses;
+}
+
+// ACMR: transformed vertices per triangle (0.5 is ideal for regular grids, 3 is worst)
+// ATVR: transformed vertices per vertex (1 is ideal)
+static void printVertexCacheStats(const char *label, const uint32_t *indices, uint32_t numIndices, uint32_t numVertices) {
+  if (numIndices == 0 || numVertices == 0) {
+    return;
+  }
+#ifdef NDEBUG
+  // the simulation is only run if its result is printed
+  if (!options.stats) {
+    return;
+  }
+#endif
+  for (uint32_t cacheSize = 16; cacheSize <= 32; cacheSize += 16) {
+    uint32_t misses = simulateVertexCache(indices, numIndices, numVertices, cacheSize);
+    double acmr = (double)misses / (numIndices / 3);
+    double atvr = (double)misses / numVertices;
+    statsPrint("%s vertex cache (%u entries): ACMR %.3f, ATVR %.3f\n", label, cacheSize, acmr, atvr);
+  }
+}
+
+// Reorders triangles for post-transform vertex cache hits, then vertices for fetch locality.
+void OptimizeMesh(Vertex *vertices, uint32_t *numVertices, uint32_t *indices, uint32_t numIndices) {
+  printVertexCacheStats("Unoptimized", indices, numIndices, *numVertices);
+  gint64 startTime = g_get_monotonic_time();
+  optimizeVertexCache(indices, numIndices, *numVertices);
+  *numVertices = optimizeVertexFetch(vertices, *numVertices, indices, numIndices);
+  double optimizeTime = (g_get_monotonic_time() - startTime) / 1000.0;
+  statsPrint("Optimized mesh in %.3f ms\n", optimizeTime);
+  printVertexCacheStats("Optimized", indices, numIndices, *numVertices);
+}
+
+// Index buffer layout: 16 bit indices if every vertex can be addressed, or if splitting the mesh into submeshes of at most
+// MAX_SUBMESH_VERTICES vertices (duplicating the vertices shared between them) takes less memory than 32 bit indices.
+// Returns the index data, which replaces indices.
+#define MAX_SUBMESH_VERTICES 65536
+
+void *SplitMesh(Vertex **vertices, uint32_t *numVertices, uint32_t *indices, uint32_t numIndices, uint32_t *indexSize, Submesh **submeshes,
+                uint32_t *numSubmeshes) {
+  uint32_t *owner = malloc(*numVertices * sizeof(uint32_t));
+  uint32_t *localIndices = malloc(*numVertices * sizeof(uint32_t));
+  uint32_t *vertexMap = malloc(numIndices * sizeof(uint32_t));
+  uint16_t *shortIndices = malloc(numIndices * sizeof(uint16_t));
+  uint32_t capacity = 4;
+  Submesh *split = malloc(capacity * sizeof(Submesh));
+  if ((*numVertices && (!owner || !localIndices)) || (numIndices && (!vertexMap || !shortIndices)) || !split) {
+    perror("Couldn't allocate submeshes");
+    exit(EXIT_FAILURE);
+  }
+  memset(owner, 0xff, *numVertices * sizeof(uint32_t));
+
+  // greedy split in triangle order, which keeps the vertex cache order intact
+  uint32_t count = 0;
+  uint32_t splitVertices = 0;
+  uint32_t submeshVertices = 0;
+  split[0] = (Submesh){};
+  for (uint32_t i = 0; i < numIndices; i += 3) {
+    const uint32_t *tri = &indices[i];
+    uint32_t fresh = 0;
+    for (int k = 0; k < 3; k++) {
+      fresh += owner[tri[k]] != count && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]);
+    }
+    if (submeshVertices + fresh > MAX_SUBMESH_VERTICES) {
+      split[count].indexCount = i - split[count].firstIndex;
+      if (++count == capacity) {
+        capacity *= 2;
+        split = realloc(split, capacity * sizeof(Submesh));
+        if (!split) {
+          perror("Couldn't allocate submeshes");
+          exit(EXIT_FAILURE);
+        }
+      }
+      split[count] = (Submesh){.firstIndex = i, .vertexOffset = splitVertices};
+      submeshVertices = 0;
+    }
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = tri[k];
+      if (owner[v] != count) {
+        owner[v] = count;
+        localIndices[v] = submeshVertices++;
+        vertexMap[splitVertices++] = v;
+      }
+      shortIndices[i + k] = localIndices[v];
+    }
+  }
+  split[count].indexCount = numIndices - split[count].firstIndex;
+  count++;
+
+  size_t shortBytes = (size_t)splitVertices * sizeof(Vertex) + (size_t)numIndices * sizeof(uint16_t);
+  size_t wideBytes = (size_t)*numVertices * sizeof(Vertex) + (size_t)numIndices * sizeof(uint32_t);
+  void *indexData = indices;
+  if (count == 1 || shortBytes < wideBytes) {
+    Vertex *splitData = malloc((splitVertices ? splitVertices : 1) * sizeof(Vertex));
+    if (!splitData) {
+      perror("Couldn't allocate submeshes");
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < splitVertices; i++) {
+      splitData[i] = (*vertices)[vertexMap[i]];
+    }
+    free(*vertices);
+    *vertices = splitData;
+    *numVertices = splitVertices;
+    free(indices);
+    indexData = shortIndices;
+    shortIndices = nullptr;
+    *indexSize = sizeof(uint16_t);
+  } else {
+    count = 1;
+    split[0] = (Submesh){.indexCount = numIndices};
+    *indexSize = sizeof(uint32_t);
+  }
+
+  free(owner);
+  free(localIndices);
+  free(vertexMap);
+  free(shortIndices);
+  *submeshes = split;
+  *numSubmeshes = count;
+  return indexData;
+}
+
+// IEEE 754 binary16, round to nearest even
+static uint16_t floatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+  if (magnitude >= 0x7f800000) {
+    // inf, nan
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+  if (magnitude >= 0x477ff000) {
+    // ≥ 65520 rounds to inf
+    return sign | 0x7c00;
+  }
+  if (magnitude < 0x38800000) {
+    // subnormal: multiples of 2^-24
+    float subnormal;
+    memcpy(&subnormal, &magnitude, sizeof(subnormal));
+    return sign | (uint16_t)lrintf(subnormal * 16777216.0f);
+  }
+  uint32_t half = (magnitude - 0x38000000) >> 13;
+  uint32_t rest = magnitude & 0x1fff;
+  half += rest > 0x1000 || (rest == 0x1000 && (half & 1));
+  return sign | half;
+}
+
+// octahedral mapping of a unit vector onto [-1, 1]², a missing normal maps to (0, 0)
+static void encodeOctahedral(const float *normal, int16_t *out) {
+  float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+  float x = l1 > 0.0f ? normal[0] / l1 : 0.0f;
+  float y = l1 > 0.0f ? normal[1] / l1 : 0.0f;
+  if (normal[2] < 0.0f) {
+    float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = foldedX;
+  }
+  out[0] = (int16_t)lrintf(x * 32767.0f);
+  out[1] = (int16_t)lrintf(y * 32767.0f);
+}
+
+// Positions become 16 bit unorm values relative to the bounding box, dequantize maps them back to model space.
+QuantizedVertex *QuantizeVertices(const Vertex *vertices, uint32_t numVertices, mat4 dequantize) {
+  vec3 min = {};
+  vec3 max = {};
+  for (uint32_t i = 0; i < numVertices; i++) {
+    for (int k = 0; k < 3; k++) {
+      min[k] = i == 0 || vertices[i].pos[k] < min[k] ? vertices[i].pos[k] : min[k];
+      max[k] = i == 0 || vertices[i].pos[k] > max[k] ? vertices[i].pos[k] : max[k];
+    }
+  }
+  vec3 extent;
+  vec3 scale;
+  for (int k = 0; k < 3; k++) {
+    extent[k] = max[k] - min[k];
+    scale[k] = extent[k] > 0.0f ? 65535.0f / extent[k] : 0.0f;
+  }
+  glm_translate_make(dequantize, min);
+  glm_scale(dequantize, extent);
+
+  QuantizedVertex *quantized = malloc((numVertices ? numVertices : 1) * sizeof(QuantizedVertex));
+  if (!quantized) {
+    perror("Couldn't allocate quantized vertices");
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t i = 0; i < numVertices; i++) {
+    const Vertex *v = &vertices[i];
+    QuantizedVertex *q = &quantized[i];
+    for (int k = 0; k < 3; k++) {
+      q->pos[k] = (uint16_t)lrintf((v->pos[k] - min[k]) * scale[k]);
+    }
+    q->pos[3] = 0;
+    encodeOctahedral(v->normal, q->normal);
+    q->texCoord[0] = floatToHalf(v->texCoord[0]);
+    q->texCoord[1] = floatToHalf(v->texCoord[1]);
+  }
+  return quantized;
+}
+
+// vertex format selected with VKT_VERTEX_FORMAT=quantized
+VertexFormat RequestedVertexFormat(void) {
+  const char *env = g_getenv("VKT_VERTEX_FORMAT");
+  return env && !strcmp(env, "quantized") ? VERTEX_FORMAT_QUANTIZED : VERTEX_FORMAT_FLOAT;
+}
+
+// converts the vertices of a loaded mesh into the vertex format of the pipeline
+void ConvertVertices(Mesh *mesh, VertexFormat format) {
+  mesh->vertexFormat = format;
+  size_t vertexSize = sizeof(Vertex);
+  if (format == VERTEX_FORMAT_QUANTIZED) {
+    mesh->quantizedVertices = QuantizeVertices(mesh->vertices, mesh->numVertices, mesh->dequantizeMatrix);
+    vertexSize = sizeof(QuantizedVertex);
+  } else {
+    glm_mat4_identity(mesh->dequantizeMatrix);
+  }
+  size_t vertexBytes = mesh->numVertices * vertexSize;
+  size_t indexBytes = (size_t)mesh->numIndices * mesh->indexSize;
+  double bytesPerTriangle = mesh->numIndices ? (vertexBytes + indexBytes) / (mesh->numIndices / 3.0) : 0.0;
+  statsPrint("Vertex buffer: %zu bytes (%zu bytes per vertex, %zu bytes as float), index buffer: %zu bytes\n", vertexBytes, vertexSize,
+             mesh->numVertices * sizeof(Vertex), indexBytes);
+  statsPrint("Buffer memory per triangle: %.1f bytes\n", bytesPerTriangle);
+}
+
+// vertices and indices are no longer needed once they are uploaded
+void ReleaseModel(Mesh *mesh) {
+  if (mesh->cache.data) {
+    UnmapMeshCache(&mesh->cache);
+  } else {
+    free(mesh->vertices);
+    free(mesh->indices);
+  }
+  free(mesh->quantizedVertices);
+  mesh->vertices = nullptr;
+  mesh->indices = nullptr;
+  mesh->quantizedVertices = nullptr;
+}
+
+void FreeMesh(Mesh *mesh) {
+  if (!mesh) {
+    return;
+  }
+  ReleaseModel(mesh);
+  g_free(mesh->submeshes);
+  g_free(mesh);
+}
@@ -0,0 +1,129 @@
+// Binary cache of loaded meshes, stored next to the model file (models/foo.obj → models/foo.obj.meshcache).
+// Layout: MeshCacheHeader, submeshes, vertices, indices. The cache is keyed on a hash of the model file contents.
+#include "vk.h"
+#include "vkTutorial.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MESH_CACHE_MAGIC 0x4d544b56 // "VKTM"
+#define MESH_CACHE_VERSION 3
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t vertexSize;
+  uint32_t numVertices;
+  uint32_t numIndices;
+  uint32_t flags;
+  uint32_t indexSize;
+  uint32_t numSubmeshes;
+} MeshCacheHeader;
+
+static_assert(sizeof(MeshCacheHeader) == 40, "vertex data must stay aligned");
+
+static char *cacheFileName(const char *modelFile) { return g_strconcat(modelFile, ".meshcache", nullptr); }
+
+// FNV-1a over 64 bit words, only used to detect changed model files
+uint64_t HashMeshSource(const void *data, size_t size) {
+  const uint64_t prime = 0x100000001b3;
+  uint64_t hash = 0xcbf29ce484222325;
+  const char *p = data;
+  for (; size >= sizeof(uint64_t); p += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    hash = (hash ^ word) * prime;
+  }
+  for (; size; p++, size--) {
+    hash = (hash ^ (unsigned char)*p) * prime;
+  }
+  return hash;
+}
+
+bool MapMeshCache(const char *modelFile, uint64_t sourceHash, uint32_t flags, MeshCache *cache) {
+  char *fileName = cacheFileName(modelFile);
+  int fd = open(fileName, O_RDONLY);
+  g_free(fileName);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat sb;
+  bool valid = fstat(fd, &sb) == 0 && (size_t)sb.st_size >= sizeof(MeshCacheHeader);
+  void *data = valid ? mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  const MeshCacheHeader *header = data;
+  size_t expectedSize = sizeof(MeshCacheHeader) + (size_t)header->numSubmeshes * sizeof(Submesh) + (size_t)header->numVertices * sizeof(Vertex) +
+                        (size_t)header->numIndices * header->indexSize;
+  valid = header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION && header->sourceHash == sourceHash &&
+          header->flags == flags && header->vertexSize == sizeof(Vertex) && (header->indexSize == 2 || header->indexSize == 4) &&
+          expectedSize == (size_t)sb.st_size;
+  if (!valid) {
+    debugPrint("Mesh cache of %s is stale\n", modelFile);
+    munmap(data, sb.st_size);
+    return false;
+  }
+
+  cache->data = data;
+  cache->size = sb.st_size;
+  cache->submeshes = (const Submesh *)(header + 1);
+  cache->numSubmeshes = header->numSubmeshes;
+  cache->vertices = (const Vertex *)(cache->submeshes + header->numSubmeshes);
+  cache->numVertices = header->numVertices;
+  cache->indices = cache->vertices + header->numVertices;
+  cache->numIndices = header->numIndices;
+  cache->indexSize = header->indexSize;
+  return true;
+}
+
+void UnmapMeshCache(MeshCache *cache) {
+  if (cache->data) {
+    munmap(cache->data, cache->size);
+    cache->data = nullptr;
+  }
+}
+
+// Failing to write the cache (e.g. read only model directory) is not an error, false is returned.
+bool WriteMeshCache(const char *modelFile, uint64_t sourceHash, uint32_t flags, const Vertex *vertices, uint32_t numVertices, const void *indices,
+                    uint32_t numIndices, uint32_t indexSize, const Submesh *submeshes, uint32_t numSubmeshes) {
+  MeshCacheHeader header = {
+      .magic = MESH_CACHE_MAGIC,
+      .version = MESH_CACHE_VERSION,
+      .sourceHash = sourceHash,
+      .vertexSize = sizeof(Vertex),
+      .numVertices = numVertices,
+      .numIndices = numIndices,
+      .flags = flags,
+      .indexSize = indexSize,
+      .numSubmeshes = numSubmeshes,
+  };
+
+  // write to a temporary file and rename it, so readers never see a partially written cache
+  char *fileName = cacheFileName(modelFile);
+  char *tmpFileName = g_strdup_printf("%s.%d", fileName, getpid());
+  FILE *file = fopen(tmpFileName, "wb");
+  bool written = file && fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(submeshes, sizeof(Submesh), numSubmeshes, file) == numSubmeshes &&
+                 fwrite(vertices, sizeof(Vertex), numVertices, file) == numVertices && fwrite(indices, indexSize, numIndices, file) == numIndices;
+  written = file && !fclose(file) && written;
+  written = written && !rename(tmpFileName, fileName);
+  if (written) {
+    debugPrint("Wrote mesh cache %s\n", fileName);
+  } else {
+    debugPrint("Couldn't write mesh cache %s\n", fileName);
+    remove(tmpFileName);
+  }
+  g_free(tmpFileName);
+  g_free(fileName);
+  return written;
+}
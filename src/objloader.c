@@ -0,0 +1,460 @@
+// Wavefront OBJ loader working directly on a memory mapped file.
+// The flex/GLib scanner in src/lexer.l is kept for comparison (cmake -DVKT_FLEX_OBJ_LOADER=ON).
+#include "vk.h"
+#include "vkTutorial.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// memory mapped file
+typedef struct {
+  const char *data;
+  size_t size;
+} MappedFile;
+
+// vertex attributes referenced by faces, in the order of an OBJ index tuple (v/vt/vn)
+enum { ATTRIB_POSITION, ATTRIB_TEXCOORD, ATTRIB_NORMAL, ATTRIB_COUNT };
+static const size_t attribComponents[ATTRIB_COUNT] = {3, 2, 3};
+
+typedef struct {
+  float *data;
+  size_t count;
+  size_t capacity;
+} AttribArray;
+
+// Models are parsed in newline aligned chunks, one chunk per thread.
+// Face indices referring to attributes of preceding chunks are resolved while merging the chunks.
+typedef struct {
+  const MappedFile *file;
+  const char *begin;
+  const char *end;
+  AttribArray attribs[ATTRIB_COUNT];
+  // index tuples of all face corners
+  ObjIndex *corners;
+  size_t numCorners;
+  size_t capCorners;
+  // number of corners per face
+  uint32_t *faceSizes;
+  size_t numFaces;
+  size_t capFaces;
+  // relative indices (corner * ATTRIB_COUNT + attribute), stored as chunk local attribute index
+  size_t *relIndices;
+  size_t numRelIndices;
+  size_t capRelIndices;
+  // prefix sums over the preceding chunks
+  size_t attribBase[ATTRIB_COUNT];
+  size_t cornerBase;
+  size_t faceBase;
+} ObjChunk;
+
+// the whole model as read from the file
+static AttribArray attribs[ATTRIB_COUNT];
+static ObjIndex *corners;
+static uint32_t *faceSizes;
+
+static const double pow10Table[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static void mapFile(const char *fileName, MappedFile *file) {
+  int fd = open(fileName, O_RDONLY);
+  if (fd == -1) {
+    perror("Couldn't open obj file");
+    exit(EXIT_FAILURE);
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    perror("Couldn't stat obj file");
+    exit(EXIT_FAILURE);
+  }
+  file->size = sb.st_size;
+  file->data = nullptr;
+  if (file->size) {
+    file->data = mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (file->data == MAP_FAILED) {
+      perror("Couldn't map obj file");
+      exit(EXIT_FAILURE);
+    }
+    madvise((void *)file->data, file->size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+}
+
+static void unmapFile(MappedFile *file) {
+  if (file->size) {
+    munmap((void *)file->data, file->size);
+  }
+}
+
+// line number of position p (only needed for error messages)
+static int lineNumber(const char *begin, const char *p) {
+  int line = 1;
+  for (const char *c = begin; c < p; c++) {
+    line += *c == '\n';
+  }
+  return line;
+}
+
+static void parseError(const MappedFile *file, const char *p, const char *what) {
+  const char *eol = memchr(p, '\n', file->data + file->size - p);
+  int len = (eol ? eol : file->data + file->size) - p;
+  printf("<%s>Error in line %d: %.*s\n", what, lineNumber(file->data, p), len, p);
+  exit(EXIT_FAILURE);
+}
+
+static inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static inline bool isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+static inline const char *skipBlanks(const char *p, const char *end) {
+  while (p < end && isBlank(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static inline const char *skipLine(const char *p, const char *end) {
+  const char *eol = memchr(p, '\n', end - p);
+  return eol ? eol + 1 : end;
+}
+
+// input: -1.234e-2, returns nullptr if no number could be read
+static const char *scanFloat(const char *p, const char *end, float *result) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p++ == '-';
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  bool anyDigit = false;
+  for (; p < end && isDigit(*p); p++, anyDigit = true) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && isDigit(*p); p++, anyDigit = true) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if (!anyDigit) {
+    return nullptr;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negativeExp = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      negativeExp = *q++ == '-';
+    }
+    if (q < end && isDigit(*q)) {
+      int exp = 0;
+      for (; q < end && isDigit(*q); q++) {
+        exp = exp < 10000 ? exp * 10 + (*q - '0') : exp;
+      }
+      exponent += negativeExp ? -exp : exp;
+      p = q;
+    }
+  }
+
+  double value = mantissa;
+  if (exponent < 0) {
+    value = -exponent <= 22 ? value / pow10Table[-exponent] : value * pow(10.0, exponent);
+  } else if (exponent > 0) {
+    value = exponent <= 22 ? value * pow10Table[exponent] : value * pow(10.0, exponent);
+  }
+  *result = negative ? -value : value;
+  return p;
+}
+
+// input: -12, returns nullptr if no number could be read
+static const char *scanInt(const char *p, const char *end, int64_t *result) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p++ == '-';
+  }
+  if (p == end || !isDigit(*p)) {
+    return nullptr;
+  }
+  int64_t value = 0;
+  for (; p < end && isDigit(*p); p++) {
+    value = value * 10 + (*p - '0');
+  }
+  *result = negative ? -value : value;
+  return p;
+}
+
+static void *growArray(void *data, size_t *capacity, size_t elemSize) {
+  *capacity = *capacity ? 2 * *capacity : 1024;
+  data = realloc(data, *capacity * elemSize);
+  if (!data) {
+    perror("Couldn't allocate model memory");
+    exit(EXIT_FAILURE);
+  }
+  return data;
+}
+
+// input: 2.234 1.134 4.234 (after v, vt or vn)
+static const char *parseAttrib(const MappedFile *file, const char *line, const char *end, ObjChunk *chunk, int attrib) {
+  AttribArray *array = &chunk->attribs[attrib];
+  size_t components = attribComponents[attrib];
+  if (array->count == array->capacity) {
+    array->data = growArray(array->data, &array->capacity, components * sizeof(float));
+  }
+  float *values = &array->data[array->count++ * components];
+  const char *p = line;
+  for (size_t i = 0; i < components; i++) {
+    p = scanFloat(skipBlanks(p, end), end, &values[i]);
+    if (!p) {
+      parseError(file, line, attrib == ATTRIB_POSITION ? "VERTEX" : attrib == ATTRIB_NORMAL ? "NORMAL" : "TEXCOORD");
+    }
+  }
+  // optional w component or vertex colors are ignored
+  return skipLine(p, end);
+}
+
+static const char *parseIndex(const char *p, const char *end, ObjChunk *chunk, int attrib) {
+  int64_t index;
+  p = scanInt(p, end, &index);
+  if (!p || index == 0 || index > UINT32_MAX) {
+    return nullptr;
+  }
+  uint32_t *dst = &((uint32_t *)chunk->corners)[chunk->numCorners * ATTRIB_COUNT + attrib];
+  if (index > 0) {
+    *dst = index - 1;
+  } else {
+    // negative indices are relative to the last read attribute (possibly in a preceding chunk)
+    if (chunk->numRelIndices == chunk->capRelIndices) {
+      chunk->relIndices = growArray(chunk->relIndices, &chunk->capRelIndices, sizeof(size_t));
+    }
+    chunk->relIndices[chunk->numRelIndices++] = chunk->numCorners * ATTRIB_COUNT + attrib;
+    *dst = (uint32_t)(int32_t)((int64_t)chunk->attribs[attrib].count + index);
+  }
+  return p;
+}
+
+// input: 5/1/2 4/3/2 3/2/1 (after f), also 5 4 3, 5/1 4/3 3/2 and 5//2 4//2 3//1
+static const char *parseFace(const MappedFile *file, const char *line, const char *end, ObjChunk *chunk) {
+  const char *p = skipBlanks(line, end);
+  size_t firstCorner = chunk->numCorners;
+  while (p < end && *p != '\n') {
+    if (chunk->numCorners == chunk->capCorners) {
+      chunk->corners = growArray(chunk->corners, &chunk->capCorners, sizeof(ObjIndex));
+    }
+    chunk->corners[chunk->numCorners] = (ObjIndex){OBJ_INDEX_NONE, OBJ_INDEX_NONE, OBJ_INDEX_NONE};
+    p = parseIndex(p, end, chunk, ATTRIB_POSITION);
+    if (p && p < end && *p == '/') {
+      p++;
+      if (p < end && *p != '/') {
+        p = parseIndex(p, end, chunk, ATTRIB_TEXCOORD);
+      }
+      if (p && p < end && *p == '/') {
+        p = parseIndex(p + 1, end, chunk, ATTRIB_NORMAL);
+      }
+    }
+    if (!p || (p < end && !isBlank(*p) && *p != '\n')) {
+      parseError(file, line, "FACE");
+    }
+    chunk->numCorners++;
+    p = skipBlanks(p, end);
+  }
+  if (chunk->numFaces == chunk->capFaces) {
+    chunk->faceSizes = growArray(chunk->faceSizes, &chunk->capFaces, sizeof(uint32_t));
+  }
+  chunk->faceSizes[chunk->numFaces++] = chunk->numCorners - firstCorner;
+  return p < end ? p + 1 : end;
+}
+
+static gpointer parseChunk(gpointer data) {
+  ObjChunk *chunk = data;
+  const MappedFile *file = chunk->file;
+  const char *p = chunk->begin;
+  const char *end = chunk->end;
+  while (p < end) {
+    if (end - p > 1 && p[0] == 'v' && isBlank(p[1])) {
+      p = parseAttrib(file, p + 2, end, chunk, ATTRIB_POSITION);
+    } else if (end - p > 2 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+      p = parseAttrib(file, p + 3, end, chunk, ATTRIB_TEXCOORD);
+    } else if (end - p > 2 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+      p = parseAttrib(file, p + 3, end, chunk, ATTRIB_NORMAL);
+    } else if (end - p > 1 && p[0] == 'f' && isBlank(p[1])) {
+      p = parseFace(file, p + 2, end, chunk);
+    } else {
+      // comments, groups, materials, …
+      p = skipLine(p, end);
+    }
+  }
+  return nullptr;
+}
+
+// copies a chunk into the final arrays, resolves relative face indices and validates all indices
+static gpointer mergeChunk(gpointer data) {
+  ObjChunk *chunk = data;
+  for (int a = 0; a < ATTRIB_COUNT; a++) {
+    size_t size = attribComponents[a] * sizeof(float);
+    memcpy(&attribs[a].data[chunk->attribBase[a] * attribComponents[a]], chunk->attribs[a].data, chunk->attribs[a].count * size);
+  }
+  ObjIndex *dst = &corners[chunk->cornerBase];
+  memcpy(dst, chunk->corners, chunk->numCorners * sizeof(ObjIndex));
+  memcpy(&faceSizes[chunk->faceBase], chunk->faceSizes, chunk->numFaces * sizeof(uint32_t));
+  uint32_t *flat = (uint32_t *)dst;
+  for (size_t i = 0; i < chunk->numRelIndices; i++) {
+    size_t pos = chunk->relIndices[i];
+    int64_t resolved = (int64_t)chunk->attribBase[pos % ATTRIB_COUNT] + (int32_t)flat[pos];
+    flat[pos] = resolved < 0 ? OBJ_INDEX_NONE - 1 : resolved;
+  }
+  for (size_t i = 0; i < chunk->numCorners * ATTRIB_COUNT; i++) {
+    size_t count = attribs[i % ATTRIB_COUNT].count;
+    if (flat[i] >= count && (i % ATTRIB_COUNT == ATTRIB_POSITION || flat[i] != OBJ_INDEX_NONE)) {
+      fprintf(stderr, "<FACE>Error: index %u out of range (%zu elements)\n", flat[i] + 1, count);
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int a = 0; a < ATTRIB_COUNT; a++) {
+    free(chunk->attribs[a].data);
+  }
+  free(chunk->corners);
+  free(chunk->faceSizes);
+  free(chunk->relIndices);
+  return nullptr;
+}
+
+static int loaderThreadCount(size_t fileSize) {
+  const size_t minChunkSize = 256 * 1024;
+  const char *env = g_getenv("VKT_LOADER_THREADS");
+  int threads = env ? atoi(env) : (int)g_get_num_processors();
+  int maxThreads = fileSize / minChunkSize + 1;
+  threads = threads < maxThreads ? threads : maxThreads;
+  return threads > 0 ? threads : 1;
+}
+
+// runs fn on every chunk, the first one on the calling thread
+static void runChunks(GThreadFunc fn, ObjChunk *chunks, int numChunks) {
+  GThread *threads[numChunks];
+  for (int i = 1; i < numChunks; i++) {
+    threads[i] = g_thread_new("obj loader", fn, &chunks[i]);
+  }
+  fn(&chunks[0]);
+  for (int i = 1; i < numChunks; i++) {
+    g_thread_join(threads[i]);
+  }
+}
+
+// not reentrant, models are parsed one at a time (see src/loader.c)
+Mesh *LoadModel(const char *fileName) {
+  gint64 startTime = g_get_monotonic_time();
+
+  MappedFile file;
+  mapFile(fileName, &file);
+
+  // skip parsing if an up-to-date binary cache exists
+  const char *env = g_getenv("VKT_MESH_CACHE");
+  bool useCache = !env || strcmp(env, "0");
+  env = g_getenv("VKT_OPTIMIZE_MESH");
+  bool optimize = !env || strcmp(env, "0");
+  uint32_t cacheFlags = optimize ? MESH_CACHE_OPTIMIZED : 0;
+  uint64_t sourceHash = HashMeshSource(file.data, file.size);
+  Mesh *mesh = g_new0(Mesh, 1);
+  if (useCache && MapMeshCache(fileName, sourceHash, cacheFlags, &mesh->cache)) {
+    unmapFile(&file);
+    mesh->vertices = (Vertex *)mesh->cache.vertices;
+    mesh->numVertices = mesh->cache.numVertices;
+    mesh->indices = (void *)mesh->cache.indices;
+    mesh->numIndices = mesh->cache.numIndices;
+    mesh->indexSize = mesh->cache.indexSize;
+    // submeshes outlive the mapping (see ReleaseModel)
+    mesh->submeshes = g_memdup2(mesh->cache.submeshes, mesh->cache.numSubmeshes * sizeof(Submesh));
+    mesh->numSubmeshes = mesh->cache.numSubmeshes;
+    mesh->cacheState = "warm";
+    double loadTime = (g_get_monotonic_time() - startTime) / 1000.0;
+    statsPrint("Loaded %s in %.3f ms (warm mesh cache)\n", fileName, loadTime);
+    debugPrint("Number of vertices: %u\n", mesh->numVertices);
+    debugPrint("Number of indices: %u (%u bit, %u submeshes)\n", mesh->numIndices, mesh->indexSize * 8, mesh->numSubmeshes);
+    ConvertVertices(mesh, RequestedVertexFormat());
+    return mesh;
+  }
+
+  // split file into newline aligned chunks
+  int numChunks = loaderThreadCount(file.size);
+  ObjChunk chunks[numChunks];
+  const char *fileEnd = file.data + file.size;
+  const char *p = file.data;
+  for (int i = 0; i < numChunks; i++) {
+    const char *end = i == numChunks - 1 ? fileEnd : file.data + file.size / numChunks * (i + 1);
+    end = end > p ? skipLine(end - 1, fileEnd) : p;
+    chunks[i] = (ObjChunk){.file = &file, .begin = p, .end = end};
+    p = end;
+  }
+  runChunks(parseChunk, chunks, numChunks);
+
+  // prefix sums
+  size_t numCorners = 0;
+  size_t numFaces = 0;
+  for (int i = 0; i < numChunks; i++) {
+    for (int a = 0; a < ATTRIB_COUNT; a++) {
+      chunks[i].attribBase[a] = attribs[a].count;
+      attribs[a].count += chunks[i].attribs[a].count;
+    }
+    chunks[i].cornerBase = numCorners;
+    chunks[i].faceBase = numFaces;
+    numCorners += chunks[i].numCorners;
+    numFaces += chunks[i].numFaces;
+  }
+  for (int a = 0; a < ATTRIB_COUNT; a++) {
+    attribs[a].data = malloc(attribs[a].count * attribComponents[a] * sizeof(float));
+  }
+  corners = malloc(numCorners * sizeof(ObjIndex));
+  faceSizes = malloc(numFaces * sizeof(uint32_t));
+  runChunks(mergeChunk, chunks, numChunks);
+  unmapFile(&file);
+
+  // quads and n-gons → triangle list of corners → unique vertices
+  const vec3 *positions = (const vec3 *)attribs[ATTRIB_POSITION].data;
+  uint32_t numTriangleCorners;
+  uint32_t numUniqueVertices;
+  uint32_t *triangles = TriangulateFaces(positions, corners, faceSizes, numFaces, &numTriangleCorners);
+  Vertex *vertices = BuildVertices(positions, (const vec2 *)attribs[ATTRIB_TEXCOORD].data, (const vec3 *)attribs[ATTRIB_NORMAL].data, corners,
+                                   triangles, numTriangleCorners, &numUniqueVertices);
+  for (int a = 0; a < ATTRIB_COUNT; a++) {
+    free(attribs[a].data);
+    attribs[a] = (AttribArray){};
+  }
+  free(corners);
+  free(faceSizes);
+
+  if (optimize) {
+    OptimizeMesh(vertices, &numUniqueVertices, triangles, numTriangleCorners);
+  }
+
+  // 16 or 32 bit indices
+  mesh->indices = SplitMesh(&vertices, &numUniqueVertices, triangles, numTriangleCorners, &mesh->indexSize, &mesh->submeshes, &mesh->numSubmeshes);
+  mesh->vertices = vertices;
+  mesh->numVertices = numUniqueVertices;
+  mesh->numIndices = numTriangleCorners;
+
+  // a load whose cache couldn't be written doesn't count as cold
+  bool cached = useCache && WriteMeshCache(fileName, sourceHash, cacheFlags, mesh->vertices, mesh->numVertices, mesh->indices, mesh->numIndices,
+                                           mesh->indexSize, mesh->submeshes, mesh->numSubmeshes);
+  mesh->cacheState = cached ? "cold" : nullptr;
+
+  double loadTime = (g_get_monotonic_time() - startTime) / 1000.0;
+  statsPrint("Loaded %s in %.3f ms (%d threads, %s mesh cache)\n", fileName, loadTime, numChunks, cached ? "cold" : "no");
+  debugPrint("Number of faces: %zu (%zu corners)\n", numFaces, numCorners);
+  debugPrint("Number of vertices: %u\n", mesh->numVertices);
+  debugPrint("Number of indices: %u (%u bit, %u submeshes)\n", mesh->numIndices, mesh->indexSize * 8, mesh->numSubmeshes);
+  ConvertVertices(mesh, RequestedVertexFormat());
+  return mesh;
+}
@@ -0,0 +1,110 @@
+// Runtime settings, command line options override the VKT_* environment variables.
+#include "vkTutorial.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Options options = {
+    .framesInFlight = 2,
+    .swapChainImages = 0,
+    .presentMode = PRESENT_MODE_FIFO,
+    .width = 800,
+    .height = 600,
+    .frames = 100,
+    .warmupFrames = 60,
+    .pipelineCache = "pipeline.cache",
+    .instances = 1,
+};
+
+// same order as PresentModePolicy
+static const char *presentModeNames[] = {"fifo", "fifo-relaxed", "mailbox", "immediate", "lowest-latency"};
+
+static int envInt(const char *name, int fallback) {
+  const char *env = g_getenv(name);
+  return env ? atoi(env) : fallback;
+}
+
+static PresentModePolicy parsePresentMode(const char *name) {
+  for (int i = 0; i < sizeof(presentModeNames) / sizeof(presentModeNames[0]); i++) {
+    if (!strcmp(name, presentModeNames[i])) {
+      return i;
+    }
+  }
+  fprintf(stderr, "Unknown present mode %s (fifo, fifo-relaxed, mailbox, immediate or lowest-latency)\n", name);
+  exit(EXIT_FAILURE);
+}
+
+void ParseOptions(int *argc, char ***argv) {
+  options.framesInFlight = envInt("VKT_FRAMES_IN_FLIGHT", options.framesInFlight);
+  options.swapChainImages = envInt("VKT_SWAPCHAIN_IMAGES", options.swapChainImages);
+  options.stats = envInt("VKT_STATS", options.stats);
+  options.headless = envInt("VKT_HEADLESS", options.headless);
+  options.output = g_strdup(g_getenv("VKT_OUTPUT"));
+  options.benchmark = envInt("VKT_BENCHMARK", options.benchmark);
+  options.benchmarkOutput = g_strdup(g_getenv("VKT_BENCHMARK_OUTPUT"));
+  options.pipelineStatistics = envInt("VKT_PIPELINE_STATS", options.pipelineStatistics);
+  options.watchShaders = envInt("VKT_WATCH_SHADERS", options.watchShaders);
+  options.wireframe = envInt("VKT_WIREFRAME", options.wireframe);
+  options.depthPrepass = envInt("VKT_DEPTH_PREPASS", options.depthPrepass);
+  options.debugNormals = envInt("VKT_DEBUG_NORMALS", options.debugNormals);
+  options.instances = envInt("VKT_INSTANCES", options.instances);
+  options.pushConstants = envInt("VKT_PUSH_CONSTANTS", options.pushConstants);
+  if (g_getenv("VKT_PIPELINE_CACHE")) {
+    options.pipelineCache = g_strdup(g_getenv("VKT_PIPELINE_CACHE"));
+  }
+  gchar *presentMode = g_strdup(g_getenv("VKT_PRESENT_MODE"));
+
+  GOptionEntry entries[] = {
+      {"frames-in-flight", 'f', 0, G_OPTION_ARG_INT, &options.framesInFlight, "Frames recorded ahead of the GPU (default: 2)", "N"},
+      {"swapchain-images", 's', 0, G_OPTION_ARG_INT, &options.swapChainImages, "Swap chain images (default: surface minimum + 1)", "N"},
+      {"present-mode", 'p', 0, G_OPTION_ARG_STRING, &presentMode, "fifo, fifo-relaxed, mailbox, immediate or lowest-latency (default: fifo)", "MODE"},
+      {"stats", 0, 0, G_OPTION_ARG_NONE, &options.stats, "Print frame statistics every second", nullptr},
+      {"pipeline-cache", 0, 0, G_OPTION_ARG_FILENAME, &options.pipelineCache, "Pipeline cache file, none if empty (default: pipeline.cache)", "FILE"},
+      {"watch-shaders", 0, 0, G_OPTION_ARG_NONE, &options.watchShaders, "Rebuild the pipeline when shaders/*.spv change", nullptr},
+      {"wireframe", 0, 0, G_OPTION_ARG_NONE, &options.wireframe, "Draw the edges of the model (toggle: W)", nullptr},
+      {"depth-prepass", 0, 0, G_OPTION_ARG_NONE, &options.depthPrepass, "Draw the depth before shading (toggle: P)", nullptr},
+      {"debug-normals", 0, 0, G_OPTION_ARG_NONE, &options.debugNormals, "Color the model by its normals (toggle: N)", nullptr},
+      {"instances", 0, 0, G_OPTION_ARG_INT, &options.instances, "Copies of the model drawn in a grid (default: 1)", "N"},
+      {"push-constants", 0, 0, G_OPTION_ARG_NONE, &options.pushConstants, "Push the combined model-view-projection matrix per draw", nullptr},
+      {"pipeline-stats", 0, 0, G_OPTION_ARG_NONE, &options.pipelineStatistics, "Count vertices, primitives and shader invocations", nullptr},
+      {"width", 0, 0, G_OPTION_ARG_INT, &options.width, "Window or offscreen image width (default: 800)", "W"},
+      {"height", 0, 0, G_OPTION_ARG_INT, &options.height, "Window or offscreen image height (default: 600)", "H"},
+      {"headless", 0, 0, G_OPTION_ARG_NONE, &options.headless, "Render offscreen without a window", nullptr},
+      {"frames", 'n', 0, G_OPTION_ARG_INT, &options.frames, "Frames rendered headless or measured per benchmarked model (default: 100)", "N"},
+      {"output", 'o', 0, G_OPTION_ARG_FILENAME, &options.output, "Write the last headless frame to a PPM file", "FILE"},
+      {"benchmark", 'b', 0, G_OPTION_ARG_NONE, &options.benchmark, "Measure load, upload and frame times of every model in models/", nullptr},
+      {"warmup", 0, 0, G_OPTION_ARG_INT, &options.warmupFrames, "Frames rendered before measuring a model (default: 60)", "N"},
+      {"benchmark-output", 0, 0, G_OPTION_ARG_FILENAME, &options.benchmarkOutput, "Results, JSON for *.json (default: CSV on stdout)", "FILE"},
+      {nullptr},
+  };
+  GOptionContext *context = g_option_context_new("- render a model with Vulkan");
+  g_option_context_add_main_entries(context, entries, nullptr);
+  GError *error = nullptr;
+  if (!g_option_context_parse(context, argc, argv, &error)) {
+    fprintf(stderr, "%s\n", error->message);
+    exit(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+  if (presentMode) {
+    options.presentMode = parsePresentMode(presentMode);
+    g_free(presentMode);
+  }
+
+  if (options.framesInFlight < 1 || options.swapChainImages < 0) {
+    fprintf(stderr, "At least one frame in flight and a positive number of swap chain images required\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.width < 1 || options.height < 1 || options.frames < 1) {
+    fprintf(stderr, "Positive width, height and number of frames required\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.warmupFrames < 0) {
+    fprintf(stderr, "Non-negative number of warm-up frames required\n");
+    exit(EXIT_FAILURE);
+  }
+  if (options.instances < 1) {
+    fprintf(stderr, "At least one instance required\n");
+    exit(EXIT_FAILURE);
+  }
+}
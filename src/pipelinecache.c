@@ -0,0 +1,75 @@
+// Pipeline cache persisted across runs (--pipeline-cache or VKT_PIPELINE_CACHE, default: pipeline.cache), so the driver
+// doesn't compile the shaders again on every launch. Caches written by another driver or device are ignored.
+#include "vkTutorial.h"
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+extern VkResult err;
+extern VkDevice device;
+extern VkPhysicalDevice physicalDevice;
+
+// used for all pipeline creation
+VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+// false if the cache was created empty
+static bool warm;
+
+// the header is written by the driver (see VkPipelineCacheHeaderVersionOne)
+static bool isCompatible(const gchar *data, gsize size) {
+  VkPipelineCacheHeaderVersionOne header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+         !memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+void CreatePipelineCache() {
+  gchar *data = nullptr;
+  gsize size = 0;
+  if (*options.pipelineCache && g_file_get_contents(options.pipelineCache, &data, &size, nullptr) && !isCompatible(data, size)) {
+    debugPrint("Pipeline cache %s was written by another driver or device, ignored\n", options.pipelineCache);
+    g_free(data);
+    data = nullptr;
+    size = 0;
+  }
+  VkPipelineCacheCreateInfo pipelineCacheInfo = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .initialDataSize = size,
+      .pInitialData = data,
+  };
+  err = vkCreatePipelineCache(device, &pipelineCacheInfo, nullptr, &pipelineCache);
+  handleError();
+  warm = data;
+  debugPrint("Pipeline cache: %s (%lu bytes)\n", warm ? "warm" : "cold", size);
+  g_free(data);
+}
+
+// "warm" if the cache was loaded from disk, else "cold"
+const char *PipelineCacheState() { return warm ? "warm" : "cold"; }
+
+// g_file_set_contents() writes a temporary file and renames it, so a crash never leaves a truncated cache behind
+void SavePipelineCache() {
+  if (!*options.pipelineCache) {
+    return;
+  }
+  size_t size;
+  err = vkGetPipelineCacheData(device, pipelineCache, &size, nullptr);
+  handleError();
+  gchar *data = g_malloc(size);
+  err = vkGetPipelineCacheData(device, pipelineCache, &size, data);
+  handleError();
+  GError *error = nullptr;
+  if (!g_file_set_contents(options.pipelineCache, data, size, &error)) {
+    // the next launch just starts cold
+    debugPrint("Couldn't write pipeline cache: %s\n", error->message);
+    g_error_free(error);
+  }
+  g_free(data);
+}
+
+void DestroyPipelineCache() { vkDestroyPipelineCache(device, pipelineCache, nullptr); }
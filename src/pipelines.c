@@ -0,0 +1,179 @@
+// Pipeline variants: described in a table and built with BuildGraphicsPipeline(). The variants needed at launch are
+// compiled in parallel on a thread pool, all of them through the shared pipeline cache, the others are built on first
+// use. Pipelines are only used by the render thread, the shader watcher replaces them at frame boundaries.
+#include "vkTutorial.h"
+#include <glib.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+extern VkResult err;
+extern VkDevice device;
+
+static const PipelineDescription pipelineDescriptions[] = {
+    [PIPELINE_DEFAULT] =
+        {
+            .name = "default",
+            .polygonMode = VK_POLYGON_MODE_FILL,
+            .cullMode = VK_CULL_MODE_BACK_BIT,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            .depthWrite = VK_TRUE,
+            .depthCompareOp = VK_COMPARE_OP_LESS,
+        },
+    [PIPELINE_WIREFRAME] =
+        {
+            .name = "wireframe",
+            .polygonMode = VK_POLYGON_MODE_LINE,
+            .cullMode = VK_CULL_MODE_NONE,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            .depthWrite = VK_TRUE,
+            .depthCompareOp = VK_COMPARE_OP_LESS,
+        },
+    // without a fragment shader, it runs once per pixel in the following shading pass
+    [PIPELINE_DEPTH_PREPASS] =
+        {
+            .name = "depth prepass",
+            .polygonMode = VK_POLYGON_MODE_FILL,
+            .cullMode = VK_CULL_MODE_BACK_BIT,
+            .colorWriteMask = 0,
+            .depthWrite = VK_TRUE,
+            .depthCompareOp = VK_COMPARE_OP_LESS,
+            .depthOnly = true,
+        },
+    [PIPELINE_DEPTH_EQUAL] =
+        {
+            .name = "depth equal",
+            .polygonMode = VK_POLYGON_MODE_FILL,
+            .cullMode = VK_CULL_MODE_BACK_BIT,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            .depthWrite = VK_FALSE,
+            .depthCompareOp = VK_COMPARE_OP_EQUAL,
+        },
+    [PIPELINE_DEBUG_NORMALS] =
+        {
+            .name = "debug normals",
+            .polygonMode = VK_POLYGON_MODE_FILL,
+            .cullMode = VK_CULL_MODE_BACK_BIT,
+            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            .depthWrite = VK_TRUE,
+            .depthCompareOp = VK_COMPARE_OP_LESS,
+            .debugColoring = DEBUG_COLORING_NORMALS,
+        },
+};
+
+static ShaderCode *shaderCode;
+static VkPipeline pipelines[PIPELINE_VARIANT_COUNT];
+// bit mask of the variants in pipelines, read by the shader watcher
+static atomic_uint createdVariants;
+
+typedef struct {
+  const ShaderCode *code;
+  VkPipeline *pipelines;
+  VkResult results[PIPELINE_VARIANT_COUNT];
+} BuildJob;
+
+static void buildVariant(gpointer data, gpointer userData) {
+  PipelineVariant variant = GPOINTER_TO_INT(data) - 1;
+  BuildJob *job = userData;
+  job->results[variant] = BuildGraphicsPipeline(&pipelineDescriptions[variant], job->code, &job->pipelines[variant]);
+}
+
+// Builds the variants of the mask in parallel (a variant per thread). On failure the built pipelines are destroyed
+// and the first error is returned. Also called on the shader watcher thread.
+VkResult BuildPipelineVariants(const ShaderCode *code, uint32_t mask, VkPipeline *variantPipelines) {
+  BuildJob job = {.code = code, .pipelines = variantPipelines};
+  GThreadPool *pool = g_thread_pool_new(buildVariant, &job, g_get_num_processors(), FALSE, nullptr);
+  for (PipelineVariant variant = 0; variant < PIPELINE_VARIANT_COUNT; variant++) {
+    if (mask & 1u << variant) {
+      // 0 can't be pushed
+      g_thread_pool_push(pool, GINT_TO_POINTER(variant + 1), nullptr);
+    }
+  }
+  // waits for all builds
+  g_thread_pool_free(pool, FALSE, TRUE);
+
+  VkResult result = VK_SUCCESS;
+  for (PipelineVariant variant = 0; variant < PIPELINE_VARIANT_COUNT; variant++) {
+    if (mask & 1u << variant && job.results[variant] && !result) {
+      result = job.results[variant];
+    }
+  }
+  for (PipelineVariant variant = 0; result && variant < PIPELINE_VARIANT_COUNT; variant++) {
+    if (mask & 1u << variant && !job.results[variant]) {
+      vkDestroyPipeline(device, variantPipelines[variant], nullptr);
+    }
+    variantPipelines[variant] = VK_NULL_HANDLE;
+  }
+  return result;
+}
+
+// the variants drawn with the initial options, see RecordCommandBuffer()
+static uint32_t launchVariants() {
+  if (options.wireframe) {
+    return 1u << PIPELINE_WIREFRAME;
+  }
+  if (options.debugNormals) {
+    return 1u << PIPELINE_DEBUG_NORMALS;
+  }
+  return options.depthPrepass ? 1u << PIPELINE_DEPTH_PREPASS | 1u << PIPELINE_DEPTH_EQUAL : 1u << PIPELINE_DEFAULT;
+}
+
+// takes ownership of the shader code
+void CompilePipelineVariants(ShaderCode *code) {
+  shaderCode = code;
+  uint32_t mask = launchVariants();
+  // compare cold and warm (cached) compilation by deleting the pipeline cache file
+  gint64 start = g_get_monotonic_time();
+  err = BuildPipelineVariants(shaderCode, mask, pipelines);
+  handleError();
+  atomic_store(&createdVariants, mask);
+  double pipelineTime = (g_get_monotonic_time() - start) / 1000.0;
+  statsPrint("%d pipelines created in %.3f ms (%s pipeline cache)\n", __builtin_popcount(mask), pipelineTime, PipelineCacheState());
+}
+
+// builds the variant on first use
+VkPipeline GetPipelineVariant(PipelineVariant variant) {
+  if (!pipelines[variant]) {
+    gint64 start = g_get_monotonic_time();
+    err = BuildGraphicsPipeline(&pipelineDescriptions[variant], shaderCode, &pipelines[variant]);
+    handleError();
+    atomic_fetch_or(&createdVariants, 1u << variant);
+    debugPrint("Pipeline %s created on first use in %.3f ms\n", pipelineDescriptions[variant].name, (g_get_monotonic_time() - start) / 1000.0);
+  }
+  return pipelines[variant];
+}
+
+uint32_t CreatedPipelineVariants() { return atomic_load(&createdVariants); }
+
+// returns the replaced pipeline, VK_NULL_HANDLE rebuilds the variant on its next use
+VkPipeline SetPipelineVariant(PipelineVariant variant, VkPipeline pipeline) {
+  VkPipeline replaced = pipelines[variant];
+  pipelines[variant] = pipeline;
+  if (pipeline) {
+    atomic_fetch_or(&createdVariants, 1u << variant);
+  } else {
+    atomic_fetch_and(&createdVariants, ~(1u << variant));
+  }
+  return replaced;
+}
+
+// takes ownership of the shader code variants are built from from now on
+void SetShaderCode(ShaderCode *code) {
+  FreeShaderCode(shaderCode);
+  shaderCode = code;
+}
+
+void FreeShaderCode(ShaderCode *code) {
+  if (!code) {
+    return;
+  }
+  g_free(code->vert);
+  g_free(code->frag);
+  g_free(code);
+}
+
+void DestroyPipelineVariants() {
+  for (PipelineVariant variant = 0; variant < PIPELINE_VARIANT_COUNT; variant++) {
+    vkDestroyPipeline(device, SetPipelineVariant(variant, VK_NULL_HANDLE), nullptr);
+  }
+  SetShaderCode(nullptr);
+}
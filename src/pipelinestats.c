@@ -0,0 +1,118 @@
+// Pipeline statistics (--pipeline-stats or VKT_PIPELINE_STATS=1): one query per frame in flight counts the work of the
+// model's draws (the shading pass only with --depth-prepass), e.g. vertex shader invocations per primitive show the
+// effect of the vertex cache optimization. Results are read like the timestamps (see src/timestamps.c), when the slot of
+// a frame is reused.
+#include "vkTutorial.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+extern VkResult err;
+extern VkDevice device;
+extern uint32_t framesInFlight;
+extern uint32_t currentFrame;
+
+// results are written in the bit order of the statistics, see PipelineStatistics
+#define PIPELINE_STATISTICS                                                                                                                          \
+  (VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |                             \
+   VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |                                 \
+   VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+static VkQueryPool queryPool = VK_NULL_HANDLE;
+// queries of each frame in flight which were begun and ended
+static bool *written;
+static PipelineStatistics latest;
+static bool hasLatest;
+// since ResetPipelineStatistics() (benchmark output)
+static PipelineStatistics sum;
+static uint64_t sumCount;
+
+// requires the pipelineStatisticsQuery feature (see CreateLogicalDevice())
+void CreatePipelineStatisticsQueries() {
+  if (!options.pipelineStatistics) {
+    return;
+  }
+  VkQueryPoolCreateInfo queryPoolInfo = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount = framesInFlight,
+      .pipelineStatistics = PIPELINE_STATISTICS,
+  };
+  err = vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool);
+  handleError();
+  written = calloc(framesInFlight, sizeof(bool));
+}
+
+// recorded outside of render passes at the beginning of the frame
+void ResetPipelineStatisticsQuery(VkCommandBuffer cmdBuffer) {
+  if (!queryPool) {
+    return;
+  }
+  vkCmdResetQueryPool(cmdBuffer, queryPool, currentFrame, 1);
+  written[currentFrame] = false;
+}
+
+void BeginPipelineStatistics(VkCommandBuffer cmdBuffer) {
+  if (queryPool) {
+    vkCmdBeginQuery(cmdBuffer, queryPool, currentFrame, 0);
+  }
+}
+
+void EndPipelineStatistics(VkCommandBuffer cmdBuffer) {
+  if (queryPool) {
+    vkCmdEndQuery(cmdBuffer, queryPool, currentFrame);
+    written[currentFrame] = true;
+  }
+}
+
+// called after the in flight fence of the frame was waited for
+void ReadPipelineStatisticsQuery(uint32_t frame) {
+  if (!queryPool || !written[frame]) {
+    return;
+  }
+  PipelineStatistics statistics;
+  err = vkGetQueryPoolResults(device, queryPool, frame, 1, sizeof(statistics), &statistics, sizeof(statistics), VK_QUERY_RESULT_64_BIT);
+  written[frame] = false;
+  if (err == VK_NOT_READY) {
+    return;
+  }
+  handleError();
+  latest = statistics;
+  hasLatest = true;
+  sum.inputVertices += statistics.inputVertices;
+  sum.inputPrimitives += statistics.inputPrimitives;
+  sum.vertexShaderInvocations += statistics.vertexShaderInvocations;
+  sum.clippingPrimitives += statistics.clippingPrimitives;
+  sum.fragmentShaderInvocations += statistics.fragmentShaderInvocations;
+  sumCount++;
+}
+
+// statistics of the last frame read, nullptr if there is none
+const PipelineStatistics *LatestPipelineStatistics() { return hasLatest ? &latest : nullptr; }
+
+// per frame average since ResetPipelineStatistics(), false if no frame was counted
+bool MeanPipelineStatistics(PipelineStatistics *mean) {
+  if (!sumCount) {
+    return false;
+  }
+  *mean = (PipelineStatistics){
+      .inputVertices = sum.inputVertices / sumCount,
+      .inputPrimitives = sum.inputPrimitives / sumCount,
+      .vertexShaderInvocations = sum.vertexShaderInvocations / sumCount,
+      .clippingPrimitives = sum.clippingPrimitives / sumCount,
+      .fragmentShaderInvocations = sum.fragmentShaderInvocations / sumCount,
+  };
+  return true;
+}
+
+void ResetPipelineStatistics() {
+  sum = (PipelineStatistics){};
+  sumCount = 0;
+}
+
+void DestroyPipelineStatisticsQueries() {
+  if (!queryPool) {
+    return;
+  }
+  vkDestroyQueryPool(device, queryPool, nullptr);
+  free(written);
+}
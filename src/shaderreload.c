@@ -0,0 +1,184 @@
+// Shader hot reload (--watch-shaders or VKT_WATCH_SHADERS=1): a thread watches shaders/ with inotify and rebuilds the
+// created pipeline variants (see src/pipelines.c) when a SPIR-V file was written. The render loop swaps them in at the
+// beginning of a frame, the replaced pipelines are destroyed once the frames in flight which may still use them have
+// finished. Variants which weren't created yet are built from the new shaders on first use.
+#include "vkTutorial.h"
+#include <glib.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define SHADER_DIR "shaders"
+// poll timeout, the watcher checks for StopShaderWatcher() in between
+#define WATCH_TIMEOUT_MS 100
+// shader compilers write several files in a row, they are rebuilt together
+#define SETTLE_TIME_MS 50
+#define MAX_RETIRED_PIPELINES 16
+
+extern VkDevice device;
+extern VkFence *inFlightFences;
+extern uint32_t framesInFlight;
+extern uint64_t submittedFrames;
+
+typedef struct {
+  VkPipeline pipeline;
+  // frames submitted before the pipeline was replaced
+  uint64_t replacedAt;
+} RetiredPipeline;
+
+typedef struct {
+  ShaderCode *code;
+  // VK_NULL_HANDLE for the variants which weren't created when the shaders changed
+  VkPipeline pipelines[PIPELINE_VARIANT_COUNT];
+} ReloadedPipelines;
+
+// built by the watcher thread, taken by the render loop
+static _Atomic(ReloadedPipelines *) reloadedPipelines;
+static atomic_bool stopWatching;
+static GThread *watcherThread;
+// render loop only
+static RetiredPipeline retiredPipelines[MAX_RETIRED_PIPELINES];
+static uint32_t numRetiredPipelines;
+
+static bool isShaderFile(const struct inotify_event *event) {
+  return event->len && (!strcmp(event->name, "vert.spv") || !strcmp(event->name, "frag.spv"));
+}
+
+// true if a shader file was written until the timeout
+static bool waitForShaderChange(int fd, int timeout) {
+  struct pollfd pollFd = {.fd = fd, .events = POLLIN};
+  if (poll(&pollFd, 1, timeout) <= 0) {
+    return false;
+  }
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length = read(fd, buffer, sizeof(buffer));
+  // EAGAIN or EINTR on the non-blocking descriptor
+  if (length <= 0) {
+    return false;
+  }
+  bool changed = false;
+  for (char *p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+    changed |= isShaderFile((struct inotify_event *)p);
+  }
+  return changed;
+}
+
+static void destroyReloadedPipelines(ReloadedPipelines *reloaded) {
+  for (PipelineVariant variant = 0; variant < PIPELINE_VARIANT_COUNT; variant++) {
+    vkDestroyPipeline(device, reloaded->pipelines[variant], nullptr);
+  }
+  FreeShaderCode(reloaded->code);
+  g_free(reloaded);
+}
+
+// the previous pipelines are kept if the shaders can't be read or compiled, e.g. while they are being written
+static void rebuildPipelines() {
+  ReloadedPipelines *reloaded = g_new0(ReloadedPipelines, 1);
+  reloaded->code = g_new0(ShaderCode, 1);
+  ShaderCode *code = reloaded->code;
+  if (!g_file_get_contents(SHADER_DIR "/vert.spv", &code->vert, &code->vertSize, nullptr) ||
+      !g_file_get_contents(SHADER_DIR "/frag.spv", &code->frag, &code->fragSize, nullptr) || code->vertSize % 4 || code->fragSize % 4) {
+    fprintf(stderr, "Shader reload: couldn't read the SPIR-V files\n");
+    destroyReloadedPipelines(reloaded);
+    return;
+  }
+  // a variant created meanwhile is built from the old shaders, it's rebuilt on its next use after the swap
+  uint32_t variants = CreatedPipelineVariants();
+  gint64 start = g_get_monotonic_time();
+  VkResult result = BuildPipelineVariants(code, variants, reloaded->pipelines);
+  if (result) {
+    fprintf(stderr, "Shader reload: pipeline creation failed (%d)\n", result);
+    destroyReloadedPipelines(reloaded);
+    return;
+  }
+  debugPrint("Shader reload: %d pipelines rebuilt in %.3f ms\n", __builtin_popcount(variants), (g_get_monotonic_time() - start) / 1000.0);
+  // pipelines the render loop didn't take yet were never used
+  ReloadedPipelines *unused = atomic_exchange(&reloadedPipelines, reloaded);
+  if (unused) {
+    destroyReloadedPipelines(unused);
+  }
+}
+
+static gpointer watchShaders(gpointer data) {
+  int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  // close-write: compiled in place, moved-to: replaced atomically
+  if (fd < 0 || inotify_add_watch(fd, SHADER_DIR, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    perror("Couldn't watch " SHADER_DIR);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return nullptr;
+  }
+  while (!atomic_load(&stopWatching)) {
+    if (!waitForShaderChange(fd, WATCH_TIMEOUT_MS)) {
+      continue;
+    }
+    while (waitForShaderChange(fd, SETTLE_TIME_MS)) {
+    }
+    rebuildPipelines();
+  }
+  close(fd);
+  return nullptr;
+}
+
+void StartShaderWatcher() {
+  if (!options.watchShaders) {
+    return;
+  }
+  atomic_store(&stopWatching, false);
+  watcherThread = g_thread_new("shader watcher", watchShaders, nullptr);
+}
+
+// Called at the beginning of a frame after its fence was waited for, i.e. the frame submitted framesInFlight frames
+// earlier has finished. Other frames in flight may still use the replaced pipelines, so they are destroyed later.
+void SwapInReloadedPipeline() {
+  for (uint32_t i = 0; i < numRetiredPipelines;) {
+    if (submittedFrames < retiredPipelines[i].replacedAt + framesInFlight) {
+      i++;
+      continue;
+    }
+    vkDestroyPipeline(device, retiredPipelines[i].pipeline, nullptr);
+    retiredPipelines[i] = retiredPipelines[--numRetiredPipelines];
+  }
+  ReloadedPipelines *reloaded = atomic_exchange(&reloadedPipelines, nullptr);
+  if (!reloaded) {
+    return;
+  }
+  if (numRetiredPipelines + PIPELINE_VARIANT_COUNT > MAX_RETIRED_PIPELINES) {
+    // shaders changing every frame, waiting for the frames in flight is still cheaper than a device wait
+    vkWaitForFences(device, framesInFlight, inFlightFences, VK_TRUE, UINT64_MAX);
+    for (uint32_t i = 0; i < numRetiredPipelines; i++) {
+      vkDestroyPipeline(device, retiredPipelines[i].pipeline, nullptr);
+    }
+    numRetiredPipelines = 0;
+  }
+  for (PipelineVariant variant = 0; variant < PIPELINE_VARIANT_COUNT; variant++) {
+    VkPipeline replaced = SetPipelineVariant(variant, reloaded->pipelines[variant]);
+    if (replaced) {
+      retiredPipelines[numRetiredPipelines++] = (RetiredPipeline){replaced, submittedFrames};
+    }
+  }
+  SetShaderCode(reloaded->code);
+  g_free(reloaded);
+  debugPrint("Shader reload: pipelines swapped in\n");
+}
+
+// called after the device is idle, the pipelines in use are destroyed by cleanupVulkan()
+void StopShaderWatcher() {
+  if (watcherThread) {
+    atomic_store(&stopWatching, true);
+    g_thread_join(watcherThread);
+    watcherThread = nullptr;
+  }
+  ReloadedPipelines *reloaded = atomic_exchange(&reloadedPipelines, nullptr);
+  if (reloaded) {
+    destroyReloadedPipelines(reloaded);
+  }
+  for (uint32_t i = 0; i < numRetiredPipelines; i++) {
+    vkDestroyPipeline(device, retiredPipelines[i].pipeline, nullptr);
+  }
+  numRetiredPipelines = 0;
+}
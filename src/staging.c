@@ -0,0 +1,400 @@
+// Uploads through one persistently mapped staging buffer used as a ring. Buffer and image copies are collected into a
+// batch and recorded into a single command buffer per flush. Each flush returns a ticket, the ring space of a flush is
+// reclaimed once the fence of its submission signals. With a separate transfer family the copies run on the transfer
+// queue and the graphics queue acquires ownership of the uploaded resources.
+#include "vkTutorial.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern VkDevice device;
+extern VkQueue graphicsQueue;
+extern VkQueue transferQueue;
+extern uint32_t graphicsQueueFamily;
+extern uint32_t transferQueueFamily;
+extern VkCommandPool cmdPool;
+extern VkCommandPool transferCmdPool;
+extern VkResult err;
+
+#define STAGING_RING_SIZE (16 * 1024 * 1024)
+// satisfies optimalBufferCopyOffsetAlignment on all known devices
+#define STAGING_ALIGNMENT 256
+#define MAX_STAGING_SUBMISSIONS 8
+// uses of uploaded data that have to wait for the copies
+#define UPLOAD_READ_ACCESS (VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT)
+#define UPLOAD_READ_STAGES (VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+
+typedef struct {
+  VkBuffer srcBuffer;
+  VkBuffer dstBuffer;
+  VkBufferCopy region;
+} StagedCopy;
+
+typedef struct {
+  VkBuffer srcBuffer;
+  VkImage image;
+  VkBufferImageCopy region;
+} StagedImageCopy;
+
+typedef struct {
+  VkFence fence;
+  // graphics queue: copies or the acquire barriers
+  VkCommandBuffer cmdBuffer;
+  // transfer queue: copies and release barriers
+  VkCommandBuffer transferCmdBuffer;
+  // ring position after the submission's data
+  uint64_t end;
+  UploadTicket ticket;
+} StagingSubmission;
+
+static VkBuffer ringBuffer;
+static Allocation ringMemory;
+// bytes allocated and retired since the ring was last empty, ring offsets are taken modulo STAGING_RING_SIZE
+static uint64_t head;
+static uint64_t tail;
+
+static StagedCopy *stagedCopies;
+static uint32_t numStagedCopies;
+static uint32_t capStagedCopies;
+static StagedImageCopy *stagedImageCopies;
+static uint32_t numStagedImageCopies;
+static uint32_t capStagedImageCopies;
+
+static StagingSubmission submissions[MAX_STAGING_SUBMISSIONS];
+static uint32_t firstSubmission;
+static uint32_t numSubmissions;
+// per submission slot, signaled by the transfer queue and waited on by the graphics queue
+static VkSemaphore transferSemaphores[MAX_STAGING_SUBMISSIONS];
+// tickets are numbered by submission, ticket 0 is always complete
+static UploadTicket lastTicket;
+static UploadTicket completedTicket;
+
+void CreateStagingRing() {
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  CreateBuffer(STAGING_RING_SIZE, usage, memoryProperties, 0, &ringBuffer, &ringMemory);
+
+  if (transferQueueFamily != graphicsQueueFamily) {
+    VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    };
+    for (int i = 0; i < MAX_STAGING_SUBMISSIONS; i++) {
+      err = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &transferSemaphores[i]);
+      handleError();
+    }
+  }
+}
+
+// waits for the oldest submission and releases its ring space
+static void retireSubmission() {
+  StagingSubmission *submission = &submissions[firstSubmission];
+  err = vkWaitForFences(device, 1, &submission->fence, VK_TRUE, UINT64_MAX);
+  handleError();
+  vkDestroyFence(device, submission->fence, nullptr);
+  vkFreeCommandBuffers(device, cmdPool, 1, &submission->cmdBuffer);
+  if (submission->transferCmdBuffer) {
+    vkFreeCommandBuffers(device, transferCmdPool, 1, &submission->transferCmdBuffer);
+  }
+  tail = submission->end;
+  completedTicket = submission->ticket;
+  firstSubmission = (firstSubmission + 1) % MAX_STAGING_SUBMISSIONS;
+  numSubmissions--;
+}
+
+static void retireCompletedSubmissions() {
+  while (numSubmissions && vkGetFenceStatus(device, submissions[firstSubmission].fence) == VK_SUCCESS) {
+    retireSubmission();
+  }
+}
+
+static void recordBufferCopies(VkCommandBuffer cmdBuffer) {
+  for (uint32_t i = 0; i < numStagedCopies;) {
+    // one command per source and destination buffer
+    uint32_t count = 1;
+    while (i + count < numStagedCopies && stagedCopies[i + count].srcBuffer == stagedCopies[i].srcBuffer &&
+           stagedCopies[i + count].dstBuffer == stagedCopies[i].dstBuffer) {
+      count++;
+    }
+    VkBufferCopy regions[count];
+    for (uint32_t k = 0; k < count; k++) {
+      regions[k] = stagedCopies[i + k].region;
+    }
+    vkCmdCopyBuffer(cmdBuffer, stagedCopies[i].srcBuffer, stagedCopies[i].dstBuffer, count, regions);
+    i += count;
+  }
+}
+
+// one barrier per staged image, returns the number of barriers
+static uint32_t stagedImageBarriers(VkImageMemoryBarrier *barriers, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess,
+                                    VkAccessFlags dstAccess, uint32_t srcFamily, uint32_t dstFamily) {
+  uint32_t numBarriers = 0;
+  for (uint32_t i = 0; i < numStagedImageCopies; i++) {
+    if (numBarriers && barriers[numBarriers - 1].image == stagedImageCopies[i].image) {
+      continue;
+    }
+    barriers[numBarriers++] = (VkImageMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = srcFamily,
+        .dstQueueFamilyIndex = dstFamily,
+        .image = stagedImageCopies[i].image,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1},
+    };
+  }
+  return numBarriers;
+}
+
+static void recordImageCopies(VkCommandBuffer cmdBuffer) {
+  // the whole image is overwritten, its previous contents can be discarded
+  VkImageMemoryBarrier barriers[numStagedImageCopies];
+  uint32_t numBarriers = stagedImageBarriers(barriers, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                             VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, numBarriers, barriers);
+  for (uint32_t i = 0; i < numStagedImageCopies; i++) {
+    StagedImageCopy *copy = &stagedImageCopies[i];
+    vkCmdCopyBufferToImage(cmdBuffer, copy->srcBuffer, copy->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy->region);
+  }
+}
+
+// Makes the copied data visible to later commands of the graphics queue. Without a separate transfer family this is
+// a single barrier, otherwise the ownership of each resource is released on the transfer and acquired on the graphics queue.
+static void recordUploadBarriers(VkCommandBuffer cmdBuffer, bool release, bool acquire) {
+  uint32_t srcFamily = release && acquire ? VK_QUEUE_FAMILY_IGNORED : transferQueueFamily;
+  uint32_t dstFamily = release && acquire ? VK_QUEUE_FAMILY_IGNORED : graphicsQueueFamily;
+  // access masks of the other queue are ignored
+  VkAccessFlags srcAccess = release ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+  VkAccessFlags dstAccess = acquire ? UPLOAD_READ_ACCESS : 0;
+  // the acquire is chained to the semaphore wait through the same stages
+  VkPipelineStageFlags srcStages = release ? VK_PIPELINE_STAGE_TRANSFER_BIT : UPLOAD_READ_STAGES;
+  VkPipelineStageFlags dstStages = acquire ? UPLOAD_READ_STAGES : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+  // + 1: no zero length arrays
+  VkBufferMemoryBarrier bufferBarriers[numStagedCopies + 1];
+  uint32_t numBufferBarriers = 0;
+  for (uint32_t i = 0; i < numStagedCopies; i++) {
+    uint32_t k = 0;
+    while (k < numBufferBarriers && bufferBarriers[k].buffer != stagedCopies[i].dstBuffer) {
+      k++;
+    }
+    if (k < numBufferBarriers) {
+      continue;
+    }
+    bufferBarriers[numBufferBarriers++] = (VkBufferMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = dstAccess,
+        .srcQueueFamilyIndex = srcFamily,
+        .dstQueueFamilyIndex = dstFamily,
+        .buffer = stagedCopies[i].dstBuffer,
+        .size = VK_WHOLE_SIZE,
+    };
+  }
+  VkImageMemoryBarrier imageBarriers[numStagedImageCopies + 1];
+  uint32_t numImageBarriers = stagedImageBarriers(imageBarriers, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                  srcAccess, dstAccess, srcFamily, dstFamily);
+  vkCmdPipelineBarrier(cmdBuffer, srcStages, dstStages, 0, 0, nullptr, numBufferBarriers, bufferBarriers, numImageBarriers, imageBarriers);
+}
+
+static VkCommandBuffer recordCopies(VkCommandPool pool, bool acquire) {
+  VkCommandBuffer cmdBuffer = beginSingleTimeCommands(pool);
+  recordBufferCopies(cmdBuffer);
+  if (numStagedImageCopies) {
+    recordImageCopies(cmdBuffer);
+  }
+  recordUploadBarriers(cmdBuffer, true, acquire);
+  err = vkEndCommandBuffer(cmdBuffer);
+  handleError();
+  return cmdBuffer;
+}
+
+// Submits all staged copies as one batch. Commands submitted later to the graphics queue see the uploaded data without
+// waiting, the ticket is only needed to wait on the CPU (e.g. before destroying a source buffer).
+UploadTicket FlushStagingRing() {
+  retireCompletedSubmissions();
+  if (!numStagedCopies && !numStagedImageCopies) {
+    return lastTicket;
+  }
+  if (numSubmissions == MAX_STAGING_SUBMISSIONS) {
+    retireSubmission();
+  }
+
+  uint32_t slot = (firstSubmission + numSubmissions) % MAX_STAGING_SUBMISSIONS;
+  StagingSubmission *submission = &submissions[slot];
+  VkFenceCreateInfo fenceInfo = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+  err = vkCreateFence(device, &fenceInfo, nullptr, &submission->fence);
+  handleError();
+
+  if (transferQueueFamily == graphicsQueueFamily) {
+    submission->transferCmdBuffer = VK_NULL_HANDLE;
+    submission->cmdBuffer = recordCopies(cmdPool, true);
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &submission->cmdBuffer,
+    };
+    // every graphics queue is able to transfer data (in the Vulkan specification)
+    err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, submission->fence);
+    handleError();
+  } else {
+    submission->transferCmdBuffer = recordCopies(transferCmdPool, false);
+    VkSubmitInfo transferSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &submission->transferCmdBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &transferSemaphores[slot],
+    };
+    err = vkQueueSubmit(transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE);
+    handleError();
+
+    // frames submitted before keep rendering during the copies, later ones wait at the first read of uploaded data
+    submission->cmdBuffer = beginSingleTimeCommands(cmdPool);
+    recordUploadBarriers(submission->cmdBuffer, false, true);
+    err = vkEndCommandBuffer(submission->cmdBuffer);
+    handleError();
+    VkPipelineStageFlags waitStages = UPLOAD_READ_STAGES;
+    VkSubmitInfo acquireSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &transferSemaphores[slot],
+        .pWaitDstStageMask = &waitStages,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &submission->cmdBuffer,
+    };
+    err = vkQueueSubmit(graphicsQueue, 1, &acquireSubmitInfo, submission->fence);
+    handleError();
+  }
+
+  submission->end = head;
+  submission->ticket = ++lastTicket;
+  numSubmissions++;
+  debugPrint("Flushed %u buffer and %u image copies\n", numStagedCopies, numStagedImageCopies);
+  numStagedCopies = 0;
+  numStagedImageCopies = 0;
+  return lastTicket;
+}
+
+bool UploadCompleted(UploadTicket ticket) {
+  retireCompletedSubmissions();
+  return ticket <= completedTicket;
+}
+
+void WaitUpload(UploadTicket ticket) {
+  while (ticket > completedTicket && numSubmissions) {
+    retireSubmission();
+  }
+}
+
+// returns the ring offset of size bytes, waiting for submissions if the ring is full
+static VkDeviceSize allocateRing(VkDeviceSize size) {
+  for (;;) {
+    if (!numSubmissions && !numStagedCopies && !numStagedImageCopies) {
+      head = tail = 0;
+    }
+    uint64_t start = (head + STAGING_ALIGNMENT - 1) & ~(uint64_t)(STAGING_ALIGNMENT - 1);
+    if (start % STAGING_RING_SIZE + size > STAGING_RING_SIZE) {
+      // no wrap around within an allocation
+      start += STAGING_RING_SIZE - start % STAGING_RING_SIZE;
+    }
+    if (start + size - tail <= STAGING_RING_SIZE) {
+      head = start + size;
+      return start % STAGING_RING_SIZE;
+    }
+    if (numSubmissions) {
+      retireSubmission();
+    } else {
+      // staged copies occupy the ring
+      FlushStagingRing();
+    }
+  }
+}
+
+static void *growStaged(void *array, uint32_t count, uint32_t *capacity, size_t elementSize) {
+  if (count < *capacity) {
+    return array;
+  }
+  *capacity = *capacity ? 2 * *capacity : 64;
+  array = realloc(array, *capacity * elementSize);
+  if (!array) {
+    perror("Couldn't allocate staged copies");
+    exit(EXIT_FAILURE);
+  }
+  return array;
+}
+
+// Records a copy between device buffers into the current batch, the source has to be owned by the transfer family.
+void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+  stagedCopies = growStaged(stagedCopies, numStagedCopies, &capStagedCopies, sizeof(StagedCopy));
+  stagedCopies[numStagedCopies++] = (StagedCopy){
+      .srcBuffer = srcBuffer,
+      .dstBuffer = dstBuffer,
+      .region = {.size = size},
+  };
+}
+
+// Records a copy of a tightly packed buffer into the whole color image, the image ends up in SHADER_READ_ONLY_OPTIMAL.
+void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+  stagedImageCopies = growStaged(stagedImageCopies, numStagedImageCopies, &capStagedImageCopies, sizeof(StagedImageCopy));
+  stagedImageCopies[numStagedImageCopies++] = (StagedImageCopy){
+      .srcBuffer = buffer,
+      .image = image,
+      .region =
+          {
+              .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1},
+              .imageExtent = {width, height, 1},
+          },
+  };
+}
+
+// Copies data into the ring, the copy into dstBuffer is recorded by the next flush.
+void StageBufferUpload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+  const char *src = data;
+  while (size) {
+    VkDeviceSize chunkSize = size < STAGING_RING_SIZE ? size : STAGING_RING_SIZE;
+    VkDeviceSize ringOffset = allocateRing(chunkSize);
+    memcpy((char *)ringMemory.mapped + ringOffset, src, chunkSize);
+
+    stagedCopies = growStaged(stagedCopies, numStagedCopies, &capStagedCopies, sizeof(StagedCopy));
+    stagedCopies[numStagedCopies++] = (StagedCopy){
+        .srcBuffer = ringBuffer,
+        .dstBuffer = dstBuffer,
+        .region = {.srcOffset = ringOffset, .dstOffset = dstOffset, .size = chunkSize},
+    };
+    src += chunkSize;
+    dstOffset += chunkSize;
+    size -= chunkSize;
+  }
+}
+
+// Copies the pixels of a whole color image into the ring, the image can't be larger than the ring.
+void StageImageUpload(VkImage image, uint32_t width, uint32_t height, const void *pixels, VkDeviceSize size) {
+  if (size > STAGING_RING_SIZE) {
+    fprintf(stderr, "Image of %ux%u pixels doesn't fit into the staging ring\n", width, height);
+    exit(EXIT_FAILURE);
+  }
+  VkDeviceSize ringOffset = allocateRing(size);
+  memcpy((char *)ringMemory.mapped + ringOffset, pixels, size);
+  CopyBufferToImage(ringBuffer, image, width, height);
+  stagedImageCopies[numStagedImageCopies - 1].region.bufferOffset = ringOffset;
+}
+
+void DestroyStagingRing() {
+  WaitUpload(FlushStagingRing());
+  free(stagedCopies);
+  stagedCopies = nullptr;
+  capStagedCopies = 0;
+  free(stagedImageCopies);
+  stagedImageCopies = nullptr;
+  capStagedImageCopies = 0;
+  for (int i = 0; i < MAX_STAGING_SUBMISSIONS; i++) {
+    vkDestroySemaphore(device, transferSemaphores[i], nullptr);
+    transferSemaphores[i] = VK_NULL_HANDLE;
+  }
+  vkDestroyBuffer(device, ringBuffer, nullptr);
+  FreeMemory(&ringMemory);
+}
@@ -0,0 +1,59 @@
+// Frame statistics printed every second with --stats (or VKT_STATS=1), also in release builds.
+#include "vkTutorial.h"
+#include <glib.h>
+#include <stdio.h>
+
+extern VkPresentModeKHR presentMode;
+extern uint32_t framesInFlight;
+extern uint32_t swapChainImagesCount;
+
+#define STATS_INTERVAL_US 1000000
+
+static gint64 lastFrameTime;
+static gint64 intervalStart;
+static uint32_t intervalFrames;
+static gint64 minFrameTime;
+static gint64 maxFrameTime;
+
+// called once per frame, frame times are measured between calls (CPU side)
+void UpdateFrameStats(void) {
+  if (!options.stats) {
+    return;
+  }
+  gint64 now = g_get_monotonic_time();
+  if (!lastFrameTime) {
+    lastFrameTime = intervalStart = now;
+    return;
+  }
+  gint64 frameTime = now - lastFrameTime;
+  lastFrameTime = now;
+  minFrameTime = !intervalFrames || frameTime < minFrameTime ? frameTime : minFrameTime;
+  maxFrameTime = !intervalFrames || frameTime > maxFrameTime ? frameTime : maxFrameTime;
+  intervalFrames++;
+
+  gint64 interval = now - intervalStart;
+  if (interval < STATS_INTERVAL_US) {
+    return;
+  }
+  printf("%.1f fps, frame time %.3f ms (min %.3f, max %.3f), present mode %s, %u frames in flight, %u swap chain images",
+         intervalFrames * 1e6 / interval, interval / 1000.0 / intervalFrames, minFrameTime / 1000.0, maxFrameTime / 1000.0,
+         options.headless ? "headless" : PresentModeName(presentMode), framesInFlight, swapChainImagesCount);
+  // rolling GPU times of the passes recorded recently
+  for (GpuPass pass = 0; pass < GPU_PASS_COUNT; pass++) {
+    double gpuTime = GpuPassTime(pass);
+    if (gpuTime >= 0.0) {
+      printf(", GPU %s %.3f ms", GpuPassName(pass), gpuTime);
+    }
+  }
+  const PipelineStatistics *statistics = LatestPipelineStatistics();
+  if (statistics) {
+    printf(", %llu vertices, %llu primitives, %llu VS invocations (%.2f per primitive), %llu clipped primitives, %llu FS invocations",
+           (unsigned long long)statistics->inputVertices, (unsigned long long)statistics->inputPrimitives,
+           (unsigned long long)statistics->vertexShaderInvocations,
+           statistics->inputPrimitives ? (double)statistics->vertexShaderInvocations / statistics->inputPrimitives : 0.0,
+           (unsigned long long)statistics->clippingPrimitives, (unsigned long long)statistics->fragmentShaderInvocations);
+  }
+  printf("\n");
+  intervalStart = now;
+  intervalFrames = 0;
+}
@@ -0,0 +1,135 @@
+// GPU pass timings: every frame in flight owns two timestamp queries per pass. The results of a frame are read when
+// its slot is reused, i.e. framesInFlight frames later after its fence was waited for, so reading never stalls.
+#include "vkTutorial.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+extern VkResult err;
+extern VkDevice device;
+extern VkPhysicalDevice physicalDevice;
+extern uint32_t graphicsQueueFamily;
+extern uint32_t framesInFlight;
+extern uint32_t currentFrame;
+
+// rolling average over the last frames (stats output)
+#define GPU_TIMES_WINDOW 64
+
+static const char *gpuPassNames[] = {"render pass", "readback"};
+
+static VkQueryPool queryPool = VK_NULL_HANDLE;
+static double nanosecondsPerTick;
+static uint64_t timestampMask;
+// passes written into the queries of each frame in flight
+static uint32_t *writtenPasses;
+static double gpuTimes[GPU_PASS_COUNT][GPU_TIMES_WINDOW];
+static uint32_t gpuTimesCount[GPU_PASS_COUNT];
+// since ResetGpuTimes() (benchmark output)
+static double gpuTimesSum[GPU_PASS_COUNT];
+static uint32_t gpuTimesSumCount[GPU_PASS_COUNT];
+
+static uint32_t queryIndex(uint32_t frame, GpuPass pass) { return (frame * GPU_PASS_COUNT + pass) * 2; }
+
+// timings are disabled if the graphics queue doesn't support timestamps
+void CreateTimestampQueries() {
+  uint32_t queueFamilyCount;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
+  uint32_t validBits = queueFamilies[graphicsQueueFamily].timestampValidBits;
+  if (!validBits) {
+    debugPrint("GPU timestamps not supported by the graphics queue\n");
+    return;
+  }
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  nanosecondsPerTick = properties.limits.timestampPeriod;
+  timestampMask = validBits == 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+  VkQueryPoolCreateInfo queryPoolInfo = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = framesInFlight * GPU_PASS_COUNT * 2,
+  };
+  err = vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool);
+  handleError();
+  writtenPasses = calloc(framesInFlight, sizeof(uint32_t));
+}
+
+// recorded outside of render passes at the beginning of the frame
+void ResetTimestampQueries(VkCommandBuffer cmdBuffer) {
+  if (!queryPool) {
+    return;
+  }
+  vkCmdResetQueryPool(cmdBuffer, queryPool, queryIndex(currentFrame, 0), GPU_PASS_COUNT * 2);
+  writtenPasses[currentFrame] = 0;
+}
+
+void BeginGpuPass(VkCommandBuffer cmdBuffer, GpuPass pass) {
+  if (queryPool) {
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, queryIndex(currentFrame, pass));
+  }
+}
+
+void EndGpuPass(VkCommandBuffer cmdBuffer, GpuPass pass) {
+  if (queryPool) {
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, queryIndex(currentFrame, pass) + 1);
+    writtenPasses[currentFrame] |= 1u << pass;
+  }
+}
+
+// called after the in flight fence of the current frame was waited for (and after DeviceWaitIdle() for all frames)
+void ReadTimestampQueries(uint32_t frame) {
+  if (!queryPool) {
+    return;
+  }
+  for (GpuPass pass = 0; pass < GPU_PASS_COUNT; pass++) {
+    if (!(writtenPasses[frame] & 1u << pass)) {
+      continue;
+    }
+    uint64_t timestamps[2];
+    err = vkGetQueryPoolResults(device, queryPool, queryIndex(frame, pass), 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                VK_QUERY_RESULT_64_BIT);
+    if (err == VK_NOT_READY) {
+      continue;
+    }
+    handleError();
+    double time = ((timestamps[1] - timestamps[0]) & timestampMask) * nanosecondsPerTick / 1e6;
+    gpuTimes[pass][gpuTimesCount[pass]++ % GPU_TIMES_WINDOW] = time;
+    gpuTimesSum[pass] += time;
+    gpuTimesSumCount[pass]++;
+  }
+  writtenPasses[frame] = 0;
+}
+
+// rolling average (ms), negative if the pass wasn't timed
+double GpuPassTime(GpuPass pass) {
+  uint32_t count = gpuTimesCount[pass] < GPU_TIMES_WINDOW ? gpuTimesCount[pass] : GPU_TIMES_WINDOW;
+  if (!count) {
+    return -1.0;
+  }
+  double sum = 0.0;
+  for (uint32_t i = 0; i < count; i++) {
+    sum += gpuTimes[pass][i];
+  }
+  return sum / count;
+}
+
+// average (ms) since ResetGpuTimes(), negative if the pass wasn't timed
+double GpuPassMeanTime(GpuPass pass) { return gpuTimesSumCount[pass] ? gpuTimesSum[pass] / gpuTimesSumCount[pass] : -1.0; }
+
+void ResetGpuTimes() {
+  for (GpuPass pass = 0; pass < GPU_PASS_COUNT; pass++) {
+    gpuTimesSum[pass] = 0.0;
+    gpuTimesSumCount[pass] = 0;
+  }
+}
+
+const char *GpuPassName(GpuPass pass) { return gpuPassNames[pass]; }
+
+void DestroyTimestampQueries() {
+  if (!queryPool) {
+    return;
+  }
+  vkDestroyQueryPool(device, queryPool, nullptr);
+  free(writtenPasses);
+}
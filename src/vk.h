@@ -1,9 +1,96 @@
 #pragma once
 
 #include <cglm/cglm.h>
-
-void LoadModel(void);
+#include <stdint.h>
 
 typedef struct {
   vec3 pos;
+  vec3 normal;
+  vec2 texCoord;
 } Vertex;
+
+// OBJ index tuple (v/vt/vn) of a face corner, zero based
+#define OBJ_INDEX_NONE UINT32_MAX
+typedef struct {
+  uint32_t pos;
+  uint32_t texCoord;
+  uint32_t normal;
+} ObjIndex;
+
+uint32_t *TriangulateFaces(const vec3 *, const ObjIndex *, const uint32_t *, uint32_t, uint32_t *);
+Vertex *BuildVertices(const vec3 *, const vec2 *, const vec3 *, const ObjIndex *, uint32_t *, uint32_t, uint32_t *);
+void OptimizeMesh(Vertex *, uint32_t *, uint32_t *, uint32_t);
+
+// range of the index buffer drawn with its own vertex offset
+typedef struct {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  int32_t vertexOffset;
+} Submesh;
+
+void *SplitMesh(Vertex **, uint32_t *, uint32_t *, uint32_t, uint32_t *, Submesh **, uint32_t *);
+
+// vertex layout of the vertex buffer, selected with VKT_VERTEX_FORMAT=quantized
+typedef enum {
+  VERTEX_FORMAT_FLOAT,
+  VERTEX_FORMAT_QUANTIZED,
+} VertexFormat;
+
+// positions: unorm relative to the bounding box (w unused), normals: octahedral snorm, texture coordinates: half float
+typedef struct {
+  uint16_t pos[4];
+  int16_t normal[2];
+  uint16_t texCoord[2];
+} QuantizedVertex;
+
+QuantizedVertex *QuantizeVertices(const Vertex *, uint32_t, mat4);
+VertexFormat RequestedVertexFormat(void);
+
+// memory mapped binary mesh cache (see src/meshcache.c)
+// flags record the processing applied to the cached mesh
+#define MESH_CACHE_OPTIMIZED 0x1
+typedef struct {
+  void *data;
+  size_t size;
+  const Vertex *vertices;
+  uint32_t numVertices;
+  const void *indices;
+  uint32_t numIndices;
+  uint32_t indexSize;
+  const Submesh *submeshes;
+  uint32_t numSubmeshes;
+} MeshCache;
+
+uint64_t HashMeshSource(const void *, size_t);
+bool MapMeshCache(const char *, uint64_t, uint32_t, MeshCache *);
+void UnmapMeshCache(MeshCache *);
+bool WriteMeshCache(const char *, uint64_t, uint32_t, const Vertex *, uint32_t, const void *, uint32_t, uint32_t, const Submesh *, uint32_t);
+
+// A loaded model. Vertices and indices are released once they are uploaded, submeshes are drawn every frame.
+typedef struct {
+  Vertex *vertices;
+  uint32_t numVertices;
+  void *indices;
+  uint32_t numIndices;
+  uint32_t indexSize;
+  Submesh *submeshes;
+  uint32_t numSubmeshes;
+  VertexFormat vertexFormat;
+  QuantizedVertex *quantizedVertices;
+  mat4 dequantizeMatrix;
+  // set if vertices and indices point into the mapped mesh cache
+  MeshCache cache;
+  // "warm" (mapped) or "cold" (parsed and written), nullptr if loaded without mesh cache
+  const char *cacheState;
+} Mesh;
+
+Mesh *LoadModel(const char *);
+void ConvertVertices(Mesh *, VertexFormat);
+void ReleaseModel(Mesh *);
+void FreeMesh(Mesh *);
+
+// background loader (see src/loader.c)
+void StartModelLoader(const char *const *);
+Mesh *PollLoadedMesh(void);
+void StopModelLoader(void);
+void SwapInMesh(Mesh *);
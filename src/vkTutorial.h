@@ -19,6 +19,128 @@
 
 #define handleError(x) _handleError(__FILE__, __LINE__)
 
+// range of a device memory block (see src/memory.c)
+typedef struct {
+  VkDeviceMemory memory;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+  // persistently mapped if the memory is host visible
+  void *mapped;
+  uint32_t memoryTypeIndex;
+  uint32_t block;
+  bool linear;
+} Allocation;
+
+// requested present mode, unsupported modes fall back to the next best one (see CreateSwapChain())
+typedef enum {
+  PRESENT_MODE_FIFO,
+  PRESENT_MODE_FIFO_RELAXED,
+  PRESENT_MODE_MAILBOX,
+  PRESENT_MODE_IMMEDIATE,
+  PRESENT_MODE_LOWEST_LATENCY,
+} PresentModePolicy;
+
+// runtime settings (see src/options.c)
+typedef struct {
+  int framesInFlight;
+  // 0: one more than the minimum of the surface
+  int swapChainImages;
+  PresentModePolicy presentMode;
+  // gboolean
+  int stats;
+  // window or offscreen image size
+  int width;
+  int height;
+  // gboolean, render offscreen without a window (see src/headless.c)
+  int headless;
+  // frames rendered in headless mode, measured frames per model in benchmark mode
+  int frames;
+  // PPM file the last headless frame is written to, may be nullptr
+  char *output;
+  // gboolean, benchmark every model (see src/benchmark.c)
+  int benchmark;
+  // frames rendered before measuring a model
+  int warmupFrames;
+  // CSV or JSON file, stdout if nullptr
+  char *benchmarkOutput;
+  // gboolean, count the work of the draws (see src/pipelinestats.c), cleared if unsupported
+  int pipelineStatistics;
+  // pipeline cache file, not persisted if empty (see src/pipelinecache.c)
+  char *pipelineCache;
+  // gboolean, rebuild the pipeline when the shaders change (see src/shaderreload.c)
+  int watchShaders;
+  // gboolean, draw the model's edges, toggled with W
+  int wireframe;
+  // gboolean, lay down the depth before shading so every pixel is shaded once, toggled with P
+  int depthPrepass;
+  // gboolean, color the model by its normals, toggled with N
+  int debugNormals;
+  // copies of the model drawn in a grid with one instanced draw
+  int instances;
+  // gboolean, combine the matrices on the CPU and push them per draw instead of multiplying them per vertex
+  int pushConstants;
+} Options;
+
+extern Options options;
+
+// identifies a submitted upload batch (see src/staging.c)
+typedef uint64_t UploadTicket;
+
+// GPU work timed with timestamp queries (see src/timestamps.c)
+typedef enum {
+  GPU_PASS_RENDER,
+  GPU_PASS_READBACK,
+  GPU_PASS_COUNT,
+} GpuPass;
+
+// counters of the model's draws in a frame, in the order the query writes them (see src/pipelinestats.c)
+typedef struct {
+  uint64_t inputVertices;
+  uint64_t inputPrimitives;
+  uint64_t vertexShaderInvocations;
+  // primitives output by the clipping stage
+  uint64_t clippingPrimitives;
+  uint64_t fragmentShaderInvocations;
+} PipelineStatistics;
+
+// graphics pipelines which differ in fixed function state (see src/pipelines.c)
+typedef enum {
+  PIPELINE_DEFAULT,
+  PIPELINE_WIREFRAME,
+  PIPELINE_DEPTH_PREPASS,
+  // shading pass after the depth prepass
+  PIPELINE_DEPTH_EQUAL,
+  PIPELINE_DEBUG_NORMALS,
+  PIPELINE_VARIANT_COUNT,
+} PipelineVariant;
+
+// fragment color, a specialization constant of shaders/shader.frag
+typedef enum {
+  DEBUG_COLORING_NONE,
+  DEBUG_COLORING_NORMALS,
+} DebugColoring;
+
+typedef struct {
+  const char *name;
+  // falls back to VK_POLYGON_MODE_FILL without the fillModeNonSolid feature
+  VkPolygonMode polygonMode;
+  VkCullModeFlags cullMode;
+  VkColorComponentFlags colorWriteMask;
+  VkBool32 depthWrite;
+  VkCompareOp depthCompareOp;
+  DebugColoring debugColoring;
+  // vertex stage only, no fragment shader invocations
+  bool depthOnly;
+} PipelineDescription;
+
+// SPIR-V code of the shaders all variants are built from
+typedef struct {
+  char *vert;
+  size_t vertSize;
+  char *frag;
+  size_t fragSize;
+} ShaderCode;
+
 #ifdef NDEBUG
 #define debugPrint(fmt, ...)
 #else
@@ -28,6 +150,19 @@
   } while (0)
 #endif
 
+// measurements printed with --stats (also in release builds), else like debugPrint
+#define statsPrint(fmt, ...)                                                                                                                         \
+  do {                                                                                                                                               \
+    if (options.stats) {                                                                                                                             \
+      printf(fmt, ##__VA_ARGS__);                                                                                                                    \
+    } else {                                                                                                                                         \
+      debugPrint(fmt, ##__VA_ARGS__);                                                                                                                \
+    }                                                                                                                                                \
+  } while (0)
+
+void ParseOptions(int *, char ***);
+void UpdateFrameStats(void);
+const char *PresentModeName(VkPresentModeKHR);
 void initGLFW();
 void initVulkan();
 void mainloop();
@@ -41,4 +176,63 @@ bool checkValidationLayerSupport();
 void DestroyDebugUtilsMessenger(VkInstance, VkDebugUtilsMessengerEXT, const VkAllocationCallbacks *);
 void drawFrame();
 void DeviceWaitIdle();
+VkCommandBuffer beginSingleTimeCommands(VkCommandPool);
+void CreateBuffer(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags, VkMemoryPropertyFlags, VkBuffer *, Allocation *);
+void CreateStagingRing();
 void CopyBuffer(VkBuffer, VkBuffer, VkDeviceSize);
+void CopyBufferToImage(VkBuffer, VkImage, uint32_t, uint32_t);
+void StageBufferUpload(VkBuffer, VkDeviceSize, const void *, VkDeviceSize);
+void StageImageUpload(VkImage, uint32_t, uint32_t, const void *, VkDeviceSize);
+UploadTicket FlushStagingRing();
+bool UploadCompleted(UploadTicket);
+void WaitUpload(UploadTicket);
+void DestroyStagingRing();
+void InitMemoryTypes(void);
+uint32_t FindMemoryTypeIndex(uint32_t, VkMemoryPropertyFlags, VkMemoryPropertyFlags);
+Allocation AllocateMemory(VkMemoryRequirements, VkMemoryPropertyFlags, VkMemoryPropertyFlags, bool);
+void FreeMemory(Allocation *);
+void PrintMemoryStats(void);
+void DestroyMemoryAllocator(void);
+VkFormat FindSupportedFormat(const VkFormat *, int, VkImageTiling, VkFormatFeatureFlags);
+void CreateImage(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags, VkImage *, Allocation *);
+void CreateOffscreenImages();
+void RecordReadback(VkCommandBuffer, uint32_t);
+const uint8_t *ReadbackFrame(uint32_t);
+void DestroyOffscreenImages();
+void RenderHeadless();
+void RunBenchmark();
+void CreateTimestampQueries();
+void ResetTimestampQueries(VkCommandBuffer);
+void BeginGpuPass(VkCommandBuffer, GpuPass);
+void EndGpuPass(VkCommandBuffer, GpuPass);
+void ReadTimestampQueries(uint32_t);
+double GpuPassTime(GpuPass);
+double GpuPassMeanTime(GpuPass);
+void ResetGpuTimes();
+const char *GpuPassName(GpuPass);
+void DestroyTimestampQueries();
+void CreatePipelineStatisticsQueries();
+void ResetPipelineStatisticsQuery(VkCommandBuffer);
+void BeginPipelineStatistics(VkCommandBuffer);
+void EndPipelineStatistics(VkCommandBuffer);
+void ReadPipelineStatisticsQuery(uint32_t);
+const PipelineStatistics *LatestPipelineStatistics();
+bool MeanPipelineStatistics(PipelineStatistics *);
+void ResetPipelineStatistics();
+void DestroyPipelineStatisticsQueries();
+void CreatePipelineCache();
+const char *PipelineCacheState();
+void SavePipelineCache();
+void DestroyPipelineCache();
+VkResult BuildGraphicsPipeline(const PipelineDescription *, const ShaderCode *, VkPipeline *);
+VkResult BuildPipelineVariants(const ShaderCode *, uint32_t, VkPipeline *);
+void CompilePipelineVariants(ShaderCode *);
+VkPipeline GetPipelineVariant(PipelineVariant);
+uint32_t CreatedPipelineVariants();
+VkPipeline SetPipelineVariant(PipelineVariant, VkPipeline);
+void SetShaderCode(ShaderCode *);
+void FreeShaderCode(ShaderCode *);
+void DestroyPipelineVariants();
+void StartShaderWatcher();
+void SwapInReloadedPipeline();
+void StopShaderWatcher();
@@ -1,4 +1,3 @@
-#define MAX_FRAMES_IN_FLIGHT 2
 #define CGLM_FORCE_DEPTH_ZERO_TO_ONE
 
 #ifdef NDEBUG
@@ -14,6 +13,7 @@ const bool enableValidationLayers = true;
 #include <bits/time.h>
 #include <cglm/cglm.h>
 #include <glib.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -22,8 +22,13 @@ const bool enableValidationLayers = true;
 
 extern GLFWwindow *window;
 extern VkResult err;
+extern uint64_t headlessFrame;
 
 uint32_t currentFrame = 0;
+// frames submitted since the start
+uint64_t submittedFrames = 0;
+// number of frames recorded ahead of the GPU, all per frame arrays have this size
+uint32_t framesInFlight;
 
 // Vulkan objects
 VkInstance instance;
@@ -32,17 +37,25 @@ VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 VkDevice device;
 VkSurfaceKHR surface;
 VkQueue graphicsQueue;
+// equal to the graphics queue if the device has no separate transfer family
+VkQueue transferQueue;
+uint32_t graphicsQueueFamily;
+uint32_t transferQueueFamily;
 VkSwapchainKHR swapChain;
 VkImage *swapChainImages;
 VkImageView *swapChainImageViews;
 uint32_t swapChainImagesCount;
 VkFormat swapChainImageFormat;
 VkExtent2D swapChainExtent;
+VkPresentModeKHR presentMode;
 VkRenderPass renderPass;
 VkPipelineLayout pipelineLayout;
-VkPipeline graphicsPipeline;
+extern VkPipelineCache pipelineCache;
+// wireframe support, else line variants are filled (see BuildGraphicsPipeline())
+static bool fillModeNonSolid;
 VkFramebuffer *swapChainFramebuffers;
 VkCommandPool cmdPool;
+VkCommandPool transferCmdPool;
 VkCommandBuffer *cmdBuffers;
 VkSemaphore *semaphoresImageAvailable;
 VkSemaphore *semaphoresFinishedRendering;
@@ -54,18 +67,18 @@ int requiredValidationLayersCount = sizeof(requiredValidationLayers) / sizeof(ch
 const char *requiredDeviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 int requiredDeviceExtensionsCount = sizeof(requiredDeviceExtensions) / sizeof(char *);
 VkBuffer vertexBuffer;
-VkDeviceMemory vertexBufferMemory;
+Allocation vertexBufferMemory;
 VkBuffer indexBuffer;
-VkDeviceMemory indexBufferMemory;
-VkBuffer uniformBuffers[MAX_FRAMES_IN_FLIGHT];
-VkDeviceMemory uniformBuffersMemory[MAX_FRAMES_IN_FLIGHT];
-void *uniformBuffersMapped[MAX_FRAMES_IN_FLIGHT];
+Allocation indexBufferMemory;
+VkBuffer *uniformBuffers;
+Allocation *uniformBuffersMemory;
+void **uniformBuffersMapped;
 VkDescriptorSetLayout descriptorSetLayout;
 VkDescriptorPool descriptorPool;
-VkDescriptorSet descriptorSets[MAX_FRAMES_IN_FLIGHT];
+VkDescriptorSet *descriptorSets;
 // trifecta of resources: image, memory and image view
 VkImage depthImage;
-VkDeviceMemory depthImageMemory;
+Allocation depthImageMemory;
 VkImageView depthImageView;
 
 typedef struct UniformBufferObject {
@@ -74,25 +87,24 @@ typedef struct UniformBufferObject {
   mat4 proj;
 } UniformBufferObject;
 
-// exits program if no appropriate memory found
-uint32_t FindMemoryTypeIndex(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties memProperties;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-  debugPrint("Memory Type Count: %u\n", memProperties.memoryTypeCount);
-  for (int i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-      uint32_t heapIndex = memProperties.memoryTypes[i].heapIndex;
-      debugPrint("Size of found memory: %lu\n", memProperties.memoryHeaps[heapIndex].size);
-      return i;
-    }
-  }
-  err = VKT_ERROR_NO_SUITABLE_MEMORY_AVAILABLE;
-  handleError();
-  return -1; // should never reach
-}
+// per draw data with --push-constants, same layout as the push_constant block of shaders/shader.vert
+typedef struct {
+  // proj * view * model, combined once per frame instead of per vertex
+  mat4 mvp;
+  // clip space offsets between neighbouring copies of the instance grid
+  vec4 instanceStepX;
+  vec4 instanceStepY;
+} PushConstants;
 
-void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer *buffer, VkDeviceMemory *bufferMemory) {
+// recorded by RecordCommandBuffer(), computed by UpdateUniformBuffer()
+static PushConstants pushConstants;
+
+// columns of the instance grid, 0 for a single instance (see shaders/shader.vert)
+static uint32_t instanceColumns() { return options.instances > 1 ? (uint32_t)ceil(sqrt(options.instances)) : 0; }
+
+// preferred memory properties are used if available
+void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties,
+                  VkBuffer *buffer, Allocation *bufferMemory) {
   VkBufferCreateInfo bufferInfo = {
       .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
       .size = size,
@@ -106,22 +118,9 @@ void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyF
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
 
-  VkMemoryPriorityAllocateInfoEXT allocInfoExt = {
-      .sType = VK_STRUCTURE_TYPE_MEMORY_PRIORITY_ALLOCATE_INFO_EXT,
-      .priority = 1.0f,
-  };
-
-  VkMemoryAllocateInfo allocInfo = {
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .pNext = &allocInfoExt,
-      .allocationSize = memRequirements.size,
-      .memoryTypeIndex = FindMemoryTypeIndex(memRequirements.memoryTypeBits, properties),
-  };
-
-  err = vkAllocateMemory(device, &allocInfo, nullptr, bufferMemory);
-  handleError();
-
-  err = vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+  // sub-allocated from a larger block (see src/memory.c)
+  *bufferMemory = AllocateMemory(memRequirements, properties, preferredProperties, true);
+  err = vkBindBufferMemory(device, *buffer, bufferMemory->memory, bufferMemory->offset);
   handleError();
 }
 
@@ -129,10 +128,13 @@ void CreateUniformBuffers() {
   VkDeviceSize bufferSize = sizeof(UniformBufferObject);
   int bufferUsageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
   int memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    CreateBuffer(bufferSize, bufferUsageFlags, memoryProperties, &uniformBuffers[i], &uniformBuffersMemory[i]);
-    err = vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
-    handleError();
+  uniformBuffers = malloc(framesInFlight * sizeof(VkBuffer));
+  uniformBuffersMemory = malloc(framesInFlight * sizeof(Allocation));
+  uniformBuffersMapped = malloc(framesInFlight * sizeof(void *));
+  for (int i = 0; i < framesInFlight; i++) {
+    // device local if the whole VRAM is host visible (resizable BAR)
+    CreateBuffer(bufferSize, bufferUsageFlags, memoryProperties, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &uniformBuffers[i], &uniformBuffersMemory[i]);
+    uniformBuffersMapped[i] = uniformBuffersMemory[i].mapped;
   }
 }
 
@@ -165,18 +167,18 @@ void CreateDescriptorSetLayout() {
 void CreateDescriptorPool() {
   VkDescriptorPoolSize poolSizes[] = {{
                                           .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                          .descriptorCount = MAX_FRAMES_IN_FLIGHT,
+                                          .descriptorCount = framesInFlight,
                                       },
                                       {
                                           .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                          .descriptorCount = MAX_FRAMES_IN_FLIGHT,
+                                          .descriptorCount = framesInFlight,
                                       }};
 
   VkDescriptorPoolCreateInfo descriptorPoolInfo = {
       .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
       .poolSizeCount = sizeof(poolSizes) / sizeof(VkDescriptorPoolSize),
       .pPoolSizes = poolSizes,
-      .maxSets = MAX_FRAMES_IN_FLIGHT,
+      .maxSets = framesInFlight,
   };
 
   err = vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool);
@@ -184,18 +186,22 @@ void CreateDescriptorPool() {
 }
 
 void CreateDescriptorSets() {
-  VkDescriptorSetLayout descriptorSetLayouts[MAX_FRAMES_IN_FLIGHT] = {descriptorSetLayout, descriptorSetLayout};
+  VkDescriptorSetLayout descriptorSetLayouts[framesInFlight];
+  for (int i = 0; i < framesInFlight; i++) {
+    descriptorSetLayouts[i] = descriptorSetLayout;
+  }
   VkDescriptorSetAllocateInfo descriptorSetInfo = {
       .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
       .descriptorPool = descriptorPool,
-      .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+      .descriptorSetCount = framesInFlight,
       .pSetLayouts = descriptorSetLayouts,
   };
+  descriptorSets = malloc(framesInFlight * sizeof(VkDescriptorSet));
 
   err = vkAllocateDescriptorSets(device, &descriptorSetInfo, descriptorSets);
   handleError();
 
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = 0; i < framesInFlight; i++) {
     VkDescriptorBufferInfo bufferInfo = {
         .buffer = uniformBuffers[i],
         .offset = 0,
@@ -228,16 +234,15 @@ void CreateDescriptorSets() {
 
 // const uint16_t indices[] = {0, 1, 2, 2, 3, 0, 4, 5, 6, 6, 7, 4};
 
-// set in src/lexer.l
-extern Vertex *vertices;
-extern int numVertices;
-extern uint32_t *indices;
-extern int numIndices;
+// vertex input of the pipeline, loaded meshes are converted into it
+VertexFormat vertexFormat;
+// the drawn mesh, nullptr until the loader thread has finished the first model
+Mesh *mesh;
 
 VkVertexInputBindingDescription *GetBindingDescriptions(int *numDescriptions) {
   VkVertexInputBindingDescription tmpDesc[] = {{
       .binding = 0,
-      .stride = sizeof(Vertex),
+      .stride = vertexFormat == VERTEX_FORMAT_QUANTIZED ? sizeof(QuantizedVertex) : sizeof(Vertex),
   }};
   int tmpDescSize = sizeof(tmpDesc);
   VkVertexInputBindingDescription *bindingDescription = malloc(tmpDescSize);
@@ -254,50 +259,96 @@ VkVertexInputAttributeDescription *GetAttributeDescriptions(int *numDescriptions
           .format = VK_FORMAT_R32G32B32_SFLOAT,
           .offset = offsetof(Vertex, pos),
       },
+      {
+          .binding = 0,
+          .location = 1,
+          .format = VK_FORMAT_R32G32B32_SFLOAT,
+          .offset = offsetof(Vertex, normal),
+      },
+      {
+          .binding = 0,
+          .location = 2,
+          .format = VK_FORMAT_R32G32_SFLOAT,
+          .offset = offsetof(Vertex, texCoord),
+      },
+  };
+  // same locations, the dequantization of positions is part of the model matrix, normals are decoded by the vertex
+  // shader (see the specialization constants in BuildGraphicsPipeline())
+  VkVertexInputAttributeDescription quantizedDesc[] = {
+      {
+          .binding = 0,
+          .location = 0,
+          .format = VK_FORMAT_R16G16B16A16_UNORM,
+          .offset = offsetof(QuantizedVertex, pos),
+      },
+      {
+          .binding = 0,
+          .location = 1,
+          .format = VK_FORMAT_R16G16_SNORM,
+          .offset = offsetof(QuantizedVertex, normal),
+      },
+      {
+          .binding = 0,
+          .location = 2,
+          .format = VK_FORMAT_R16G16_SFLOAT,
+          .offset = offsetof(QuantizedVertex, texCoord),
+      },
   };
   int tmpDescSize = sizeof(tmpDesc);
   VkVertexInputAttributeDescription *attributeDescriptions = malloc(tmpDescSize);
-  memcpy(attributeDescriptions, tmpDesc, tmpDescSize);
+  memcpy(attributeDescriptions, vertexFormat == VERTEX_FORMAT_QUANTIZED ? quantizedDesc : tmpDesc, tmpDescSize);
   *numDescriptions = tmpDescSize / sizeof(VkVertexInputAttributeDescription);
   return attributeDescriptions;
 }
 
-static void createBuffer(VkBuffer *buffer, VkDeviceMemory *bufferMemory, VkDeviceSize bufferSize, int flags, void *input) {
-  // create staging buffer
-  int usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-  int memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  CreateBuffer(bufferSize, usageFlags, memoryProperties, &stagingBuffer, &stagingBufferMemory);
-
-  // fill staging buffer
-  void *data;
-  err = vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-  handleError();
-  memcpy(data, input, bufferSize);
-  vkUnmapMemory(device, stagingBufferMemory);
+static void createBuffer(VkBuffer *buffer, Allocation *bufferMemory, VkDeviceSize bufferSize, int flags, const void *input) {
+  int usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | flags;
+  int memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  CreateBuffer(bufferSize, usageFlags, memoryProperties, 0, buffer, bufferMemory);
 
-  // create buffer
-  usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | flags;
-  memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-  CreateBuffer(bufferSize, usageFlags, memoryProperties, buffer, bufferMemory);
+  // copied into the staging ring right away (input may point directly into the memory mapped mesh cache),
+  // the transfer is submitted by FlushStagingRing()
+  StageBufferUpload(*buffer, 0, input, bufferSize);
+}
 
-  // copy from staging buffer to vertex buffer
-  CopyBuffer(stagingBuffer, *buffer, bufferSize);
+void CreateVertexBuffer(const Mesh *mesh) {
+  if (mesh->vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+    VkDeviceSize bufferSize = mesh->numVertices * sizeof(QuantizedVertex);
+    createBuffer(&vertexBuffer, &vertexBufferMemory, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh->quantizedVertices);
+  } else {
+    VkDeviceSize bufferSize = mesh->numVertices * sizeof(Vertex);
+    createBuffer(&vertexBuffer, &vertexBufferMemory, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh->vertices);
+  }
+}
 
-  // cleanup staging buffer
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+void CreateIndexBuffer(const Mesh *mesh) {
+  VkDeviceSize bufferSize = (VkDeviceSize)mesh->numIndices * mesh->indexSize;
+  createBuffer(&indexBuffer, &indexBufferMemory, bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mesh->indices);
 }
 
-void CreateVertexBuffer() {
-  VkDeviceSize bufferSize = numVertices * sizeof(Vertex);
-  createBuffer(&vertexBuffer, &vertexBufferMemory, bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices);
+static void destroyMeshBuffers() {
+  vkDestroyBuffer(device, indexBuffer, nullptr);
+  FreeMemory(&indexBufferMemory);
+  vkDestroyBuffer(device, vertexBuffer, nullptr);
+  FreeMemory(&vertexBufferMemory);
+  FreeMesh(mesh);
+  mesh = nullptr;
 }
 
-void CreateIndexBuffer() {
-  VkDeviceSize bufferSize = numIndices * sizeof(uint32_t);
-  createBuffer(&indexBuffer, &indexBufferMemory, bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices);
+// Replaces the drawn mesh with one finished by the loader thread. Frames recorded afterwards are ordered after the
+// upload on the graphics queue, so the CPU doesn't wait for the copies.
+void SwapInMesh(Mesh *loadedMesh) {
+  if (mesh) {
+    // the previous mesh may still be drawn by frames in flight
+    err = vkWaitForFences(device, framesInFlight, inFlightFences, VK_TRUE, UINT64_MAX);
+    handleError();
+    destroyMeshBuffers();
+  }
+  CreateVertexBuffer(loadedMesh);
+  CreateIndexBuffer(loadedMesh);
+  FlushStagingRing();
+  ReleaseModel(loadedMesh);
+  mesh = loadedMesh;
 }
 
 VKAPI_PTR VkBool32 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageTypes,
@@ -474,7 +525,61 @@ void CreateInstance() {
   free(requiredExtensions);
 }
 
+const char *PresentModeName(VkPresentModeKHR mode) {
+  switch (mode) {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR:
+    return "immediate";
+  case VK_PRESENT_MODE_MAILBOX_KHR:
+    return "mailbox";
+  case VK_PRESENT_MODE_FIFO_KHR:
+    return "fifo";
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+    return "fifo relaxed";
+  case VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR:
+    return "shared demand refresh";
+  case VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR:
+    return "shared continuous refresh";
+  default:
+    return "unknown";
+  }
+}
+
+// first supported mode of the policy's preference list, the lists end with fifo which is always supported
+static VkPresentModeKHR choosePresentMode(const VkPresentModeKHR *presentModes, uint32_t presentModeCount) {
+  static const VkPresentModeKHR preferences[][4] = {
+      [PRESENT_MODE_FIFO] = {VK_PRESENT_MODE_FIFO_KHR},
+      [PRESENT_MODE_FIFO_RELAXED] = {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR},
+      // uncapped without tearing, otherwise with tearing
+      [PRESENT_MODE_MAILBOX] = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR},
+      [PRESENT_MODE_IMMEDIATE] = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR},
+      [PRESENT_MODE_LOWEST_LATENCY] = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+                                       VK_PRESENT_MODE_FIFO_KHR},
+  };
+  const VkPresentModeKHR *preference = preferences[options.presentMode];
+  int i = 0;
+  for (; preference[i] != VK_PRESENT_MODE_FIFO_KHR; i++) {
+    bool supported = false;
+    for (int k = 0; k < presentModeCount; k++) {
+      supported |= presentModes[k] == preference[i];
+    }
+    if (supported) {
+      break;
+    }
+  }
+  // the swap chain is recreated on every resize, a fallback is only reported when it changes
+  static VkPresentModeKHR reportedFallback = VK_PRESENT_MODE_MAX_ENUM_KHR;
+  if (i && preference[i] != reportedFallback) {
+    fprintf(stderr, "Present mode %s not supported, using %s\n", PresentModeName(preference[0]), PresentModeName(preference[i]));
+    reportedFallback = preference[i];
+  }
+  return preference[i];
+}
+
 void CreateSwapChain() {
+  if (options.headless) {
+    CreateOffscreenImages();
+    return;
+  }
   debugPrint("  Swap Chain Support:\n");
 
   // surface capabilities
@@ -640,19 +745,7 @@ void CreateSwapChain() {
   handleError();
   debugPrint("    Surface presentation modes:\n");
   for (int i = 0; i < presentModeCount; i++) {
-    if (presentModes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-      debugPrint("      immediate\n");
-    } else if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-      debugPrint("      mailbox\n");
-    } else if (presentModes[i] == VK_PRESENT_MODE_FIFO_KHR) {
-      debugPrint("      fifo\n");
-    } else if (presentModes[i] == VK_PRESENT_MODE_FIFO_RELAXED_KHR) {
-      debugPrint("      fifo relaxed\n");
-    } else if (presentModes[i] == VK_PRESENT_MODE_SHARED_DEMAND_REFRESH_KHR) {
-      debugPrint("      shared demand refresh\n");
-    } else if (presentModes[i] == VK_PRESENT_MODE_SHARED_CONTINUOUS_REFRESH_KHR) {
-      debugPrint("      shared continuous refresh\n");
-    }
+    debugPrint("      %s\n", PresentModeName(presentModes[i]));
   }
 
   // For us it's sufficient to have a surface format and a presentation mode.
@@ -662,9 +755,18 @@ void CreateSwapChain() {
   }
 
   // create swapchain
-  swapChainImagesCount = surfaceCapabilities.minImageCount + 1;
+  swapChainImagesCount = options.swapChainImages ? options.swapChainImages : surfaceCapabilities.minImageCount + 1;
+  if (swapChainImagesCount < surfaceCapabilities.minImageCount) {
+    swapChainImagesCount = surfaceCapabilities.minImageCount;
+  }
+  // 0 means no limit
+  if (surfaceCapabilities.maxImageCount && swapChainImagesCount > surfaceCapabilities.maxImageCount) {
+    swapChainImagesCount = surfaceCapabilities.maxImageCount;
+  }
   swapChainImageFormat = surfaceFormats[0].format;
   swapChainExtent = surfaceCapabilities.currentExtent;
+  presentMode = choosePresentMode(presentModes, presentModeCount);
+  debugPrint("    Present mode: %s\n", PresentModeName(presentMode));
   VkSwapchainCreateInfoKHR swapchainCreateInfo = {
       .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
       .surface = surface,
@@ -677,7 +779,7 @@ void CreateSwapChain() {
       .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
       .preTransform = surfaceCapabilities.currentTransform,
       .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-      .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+      .presentMode = presentMode,
       .clipped = VK_TRUE,
       .oldSwapchain = VK_NULL_HANDLE,
   };
@@ -691,6 +793,7 @@ void CreateSwapChain() {
   swapChainImages = malloc(swapChainImagesCount * sizeof(VkImage));
   err = vkGetSwapchainImagesKHR(device, swapChain, &swapChainImagesCount, swapChainImages);
   handleError();
+  debugPrint("Swap chain images: %u\n", swapChainImagesCount);
 }
 
 bool isPhysicalDeviceSuitable(VkPhysicalDevice physicalDevice) {
@@ -923,9 +1026,10 @@ bool isPhysicalDeviceSuitable(VkPhysicalDevice physicalDevice) {
   handleError();
   debugPrint("  All required device extensions are available: true\n");
 
-  // This is the criteria for being a suitable physical device: being a GPU!
+  // This is the criteria for being a suitable physical device: being a GPU! Headless rendering also runs on the CPU (lavapipe).
   return physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ||
-         physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+         physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+         (options.headless && physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU);
 }
 
 int fstGraphicsQueueFamilyIndex() {
@@ -939,8 +1043,12 @@ int fstGraphicsQueueFamilyIndex() {
   VkBool32 surfaceSupport = VK_FALSE;
   for (int i = 0; i < queueFamilyCount; i++) {
     if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-      err = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &surfaceSupport);
-      handleError();
+      // nothing is presented in headless mode
+      surfaceSupport = options.headless;
+      if (!surfaceSupport) {
+        err = vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &surfaceSupport);
+        handleError();
+      }
       if (surfaceSupport) {
         debugPrint("\nFirst graphics queue family index: %d\n", i);
         result = i;
@@ -956,6 +1064,39 @@ int fstGraphicsQueueFamilyIndex() {
   return result;
 }
 
+// Prefers a transfer only family (copy engine) over a compute family without graphics, uploads on it run concurrently
+// to rendering. Falls back to the graphics family, also if VKT_TRANSFER_QUEUE=0.
+int transferQueueFamilyIndex(int graphicsFamily) {
+  const char *env = g_getenv("VKT_TRANSFER_QUEUE");
+  if (env && !strcmp(env, "0")) {
+    return graphicsFamily;
+  }
+
+  uint32_t queueFamilyCount;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+  VkQueueFamilyProperties queueFamilies[queueFamilyCount];
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies);
+
+  int result = graphicsFamily;
+  for (int i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (flags & VK_QUEUE_GRAPHICS_BIT) {
+      continue;
+    }
+    // transfer is implied by compute
+    if (!(flags & VK_QUEUE_COMPUTE_BIT) && (flags & VK_QUEUE_TRANSFER_BIT)) {
+      result = i;
+      break;
+    }
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && result == graphicsFamily) {
+      result = i;
+    }
+  }
+  debugPrint("Transfer queue family index: %d\n", result);
+  return result;
+}
+
 void PrintQueueFamilies() {
   uint32_t queueFamilyCount;
   vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
@@ -1032,23 +1173,44 @@ void PickPhysicalDevice() {
 }
 
 void CreateLogicalDevice() {
-  int queueFamilyIndex = fstGraphicsQueueFamilyIndex();
+  graphicsQueueFamily = fstGraphicsQueueFamilyIndex();
+  transferQueueFamily = transferQueueFamilyIndex(graphicsQueueFamily);
   float queuePriority = 1.0f;
-  VkDeviceQueueCreateInfo deviceQueueCreateInfo = {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-      .queueFamilyIndex = queueFamilyIndex,
-      .queueCount = 1,
-      .pQueuePriorities = &queuePriority,
+  VkDeviceQueueCreateInfo deviceQueueCreateInfos[] = {
+      {
+          .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+          .queueFamilyIndex = graphicsQueueFamily,
+          .queueCount = 1,
+          .pQueuePriorities = &queuePriority,
+      },
+      {
+          .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+          .queueFamilyIndex = transferQueueFamily,
+          .queueCount = 1,
+          .pQueuePriorities = &queuePriority,
+      },
   };
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+  if (options.pipelineStatistics && !supportedFeatures.pipelineStatisticsQuery) {
+    debugPrint("Pipeline statistics queries not supported\n");
+    options.pipelineStatistics = false;
+  }
+  fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+  if (!fillModeNonSolid) {
+    debugPrint("Wireframe not supported, filled instead\n");
+  }
   VkPhysicalDeviceFeatures deviceFeatures = {
       .samplerAnisotropy = VK_TRUE,
+      .fillModeNonSolid = fillModeNonSolid,
+      .pipelineStatisticsQuery = options.pipelineStatistics,
   };
 
   VkDeviceCreateInfo deviceCreateInfo = {
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-      .queueCreateInfoCount = 1,
-      .pQueueCreateInfos = &deviceQueueCreateInfo,
+      .queueCreateInfoCount = transferQueueFamily != graphicsQueueFamily ? 2 : 1,
+      .pQueueCreateInfos = deviceQueueCreateInfos,
       .enabledExtensionCount = requiredDeviceExtensionsCount,
       .ppEnabledExtensionNames = requiredDeviceExtensions,
       .pEnabledFeatures = &deviceFeatures,
@@ -1057,7 +1219,8 @@ void CreateLogicalDevice() {
   err = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device);
   handleError();
   uint32_t queueIndex = 0;
-  vkGetDeviceQueue(device, queueFamilyIndex, queueIndex, &graphicsQueue);
+  vkGetDeviceQueue(device, graphicsQueueFamily, queueIndex, &graphicsQueue);
+  vkGetDeviceQueue(device, transferQueueFamily, queueIndex, &transferQueue);
 }
 
 VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
@@ -1115,7 +1278,7 @@ VkFormat FindDepthFormat() {
 }
 
 void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-                 VkImage *image, VkDeviceMemory *imageMemory) {
+                 VkImage *image, Allocation *imageMemory) {
 
   VkImageCreateInfo imageInfo = {
       .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -1139,22 +1302,9 @@ void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling
   VkMemoryRequirements memRequirements;
   vkGetImageMemoryRequirements(device, *image, &memRequirements);
 
-  VkMemoryPriorityAllocateInfoEXT allocInfoExt = {
-      .sType = VK_STRUCTURE_TYPE_MEMORY_PRIORITY_ALLOCATE_INFO_EXT,
-      .priority = 1.0f,
-  };
-
-  VkMemoryAllocateInfo allocInfo = {
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize = memRequirements.size,
-      .pNext = &allocInfoExt,
-      .memoryTypeIndex = FindMemoryTypeIndex(memRequirements.memoryTypeBits, properties),
-  };
-
-  err = vkAllocateMemory(device, &allocInfo, nullptr, imageMemory);
-  handleError();
-
-  err = vkBindImageMemory(device, *image, *imageMemory, 0);
+  // optimal tiling images get their own pools, linear images would have to share them with buffers
+  *imageMemory = AllocateMemory(memRequirements, properties, 0, tiling == VK_IMAGE_TILING_LINEAR);
+  err = vkBindImageMemory(device, *image, imageMemory->memory, imageMemory->offset);
   handleError();
 }
 
@@ -1179,7 +1329,8 @@ void CreateRenderPass() {
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+      // offscreen images are copied into readback buffers (see RecordReadback())
+      .finalLayout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
   };
 
   VkAttachmentDescription depthAttachment = {
@@ -1213,13 +1364,24 @@ void CreateRenderPass() {
   // search for 'VkClearValue clearValues'
   VkAttachmentDescription attachments[] = {colorAttachment, depthAttachment};
 
-  VkSubpassDependency dependency = {
-      .srcSubpass = VK_SUBPASS_EXTERNAL,
-      .dstSubpass = 0,
-      .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-      .srcAccessMask = 0,
-      .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+  VkSubpassDependency dependencies[] = {
+      {
+          .srcSubpass = VK_SUBPASS_EXTERNAL,
+          .dstSubpass = 0,
+          .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+          .srcAccessMask = 0,
+          .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+          .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      },
+      // headless only: the readback copy waits for the rendered image
+      {
+          .srcSubpass = 0,
+          .dstSubpass = VK_SUBPASS_EXTERNAL,
+          .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+          .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+          .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+          .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+      },
   };
 
   VkRenderPassCreateInfo renderPassInfo = {
@@ -1228,56 +1390,79 @@ void CreateRenderPass() {
       .pAttachments = attachments,
       .subpassCount = 1,
       .pSubpasses = &subpass,
-      .dependencyCount = 1,
-      .pDependencies = &dependency,
+      .dependencyCount = options.headless ? 2 : 1,
+      .pDependencies = dependencies,
   };
 
   err = vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass);
   handleError();
 }
 
-VkShaderModule createShaderModule(gchar *code, gsize codeSize) {
+VkResult createShaderModule(const char *code, size_t codeSize, VkShaderModule *shaderModule) {
   VkShaderModuleCreateInfo shaderInfo = {
       .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
       .pCode = (const uint32_t *)code,
       .codeSize = codeSize,
   };
 
-  VkShaderModule shaderModule;
-  err = vkCreateShaderModule(device, &shaderInfo, nullptr, &shaderModule);
-  handleError();
-
-  return shaderModule;
+  return vkCreateShaderModule(device, &shaderInfo, nullptr, shaderModule);
 }
 
 gboolean readFile(const char *filename, gchar **contents, gsize *len) { return g_file_get_contents(filename, contents, len, nullptr); }
 
-void CreatePipeline() {
-  // Shaders
-  gchar *vertShaderCode;
-  gchar *fragShaderCode;
-  gsize lenVertShaderCode;
-  gsize lenFragShaderCode;
-  if (!readFile("shaders/vert.spv", &vertShaderCode, &lenVertShaderCode)) {
-    err = VKT_ERROR_NO_VERT_SHADER;
-    handleError();
-  }
-  if (!readFile("shaders/frag.spv", &fragShaderCode, &lenFragShaderCode)) {
-    err = VKT_ERROR_NO_FRAG_SHADER;
-    handleError();
-  }
-
-  debugPrint("Code size vertex   shader: %5lu, divisible by 4: %s\n", lenVertShaderCode, lenVertShaderCode % 4 ? "false" : "true");
-  debugPrint("Code size fragment shader: %5lu, divisible by 4: %s\n", lenFragShaderCode, lenFragShaderCode % 4 ? "false" : "true");
-
-  VkShaderModule vertShaderModule = createShaderModule(vertShaderCode, lenVertShaderCode);
-  VkShaderModule fragShaderModule = createShaderModule(fragShaderCode, lenFragShaderCode);
+// specialization constants of the shaders, features compiled out aren't branched on at runtime
+typedef struct {
+  // constant_id 0, VkBool32 for GLSL bools
+  VkBool32 dequantize;
+  // constant_id 1, 0 for a single instance
+  uint32_t instanceColumns;
+  // constant_id 2
+  uint32_t debugColoring;
+  // constant_id 3
+  VkBool32 pushConstants;
+} SpecializationConstants;
+
+// Builds a pipeline variant with the layout and render pass created at startup. Called on the thread pool of
+// src/pipelines.c and on the shader reload thread (see src/shaderreload.c), so errors are returned instead of handled.
+VkResult BuildGraphicsPipeline(const PipelineDescription *description, const ShaderCode *code, VkPipeline *pipeline) {
+  VkShaderModule vertShaderModule;
+  VkShaderModule fragShaderModule;
+  VkResult result = createShaderModule(code->vert, code->vertSize, &vertShaderModule);
+  if (result) {
+    return result;
+  }
+  result = createShaderModule(code->frag, code->fragSize, &fragShaderModule);
+  if (result) {
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    return result;
+  }
+
+  // both stages share the constants, entries a stage doesn't declare are ignored
+  SpecializationConstants constants = {
+      .dequantize = vertexFormat == VERTEX_FORMAT_QUANTIZED,
+      .instanceColumns = instanceColumns(),
+      .debugColoring = description->debugColoring,
+      .pushConstants = options.pushConstants,
+  };
+  VkSpecializationMapEntry specializationEntries[] = {
+      {.constantID = 0, .offset = offsetof(SpecializationConstants, dequantize), .size = sizeof(VkBool32)},
+      {.constantID = 1, .offset = offsetof(SpecializationConstants, instanceColumns), .size = sizeof(uint32_t)},
+      {.constantID = 2, .offset = offsetof(SpecializationConstants, debugColoring), .size = sizeof(uint32_t)},
+      {.constantID = 3, .offset = offsetof(SpecializationConstants, pushConstants), .size = sizeof(VkBool32)},
+  };
+  VkSpecializationInfo specializationInfo = {
+      .mapEntryCount = sizeof(specializationEntries) / sizeof(VkSpecializationMapEntry),
+      .pMapEntries = specializationEntries,
+      .dataSize = sizeof(constants),
+      .pData = &constants,
+  };
 
   VkPipelineShaderStageCreateInfo vertShaderStageInfo = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
       .stage = VK_SHADER_STAGE_VERTEX_BIT,
       .module = vertShaderModule,
       .pName = "main",
+      .pSpecializationInfo = &specializationInfo,
   };
 
   VkPipelineShaderStageCreateInfo fragShaderStageInfo = {
@@ -1285,6 +1470,7 @@ void CreatePipeline() {
       .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
       .module = fragShaderModule,
       .pName = "main",
+      .pSpecializationInfo = &specializationInfo,
   };
 
   VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
@@ -1316,9 +1502,9 @@ void CreatePipeline() {
 
   VkPipelineRasterizationStateCreateInfo rasterizer = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-      .polygonMode = VK_POLYGON_MODE_FILL,
+      .polygonMode = fillModeNonSolid ? description->polygonMode : VK_POLYGON_MODE_FILL,
       .lineWidth = 1.0f,
-      .cullMode = VK_CULL_MODE_BACK_BIT,
+      .cullMode = description->cullMode,
       .frontFace = VK_FRONT_FACE_CLOCKWISE,
   };
 
@@ -1328,7 +1514,7 @@ void CreatePipeline() {
   };
 
   VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+      .colorWriteMask = description->colorWriteMask,
   };
 
   VkPipelineColorBlendStateCreateInfo colorBlending = {
@@ -1337,21 +1523,11 @@ void CreatePipeline() {
       .pAttachments = &colorBlendAttachment,
   };
 
-  // uniform variables (see CreateDescriptorSetLayout(…))
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-      .setLayoutCount = 1,
-      .pSetLayouts = &descriptorSetLayout,
-  };
-
-  err = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
-  handleError();
-
   VkPipelineDepthStencilStateCreateInfo depthStencil = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
       .depthTestEnable = VK_TRUE,
-      .depthWriteEnable = VK_TRUE,
-      .depthCompareOp = VK_COMPARE_OP_LESS,
+      .depthWriteEnable = description->depthWrite,
+      .depthCompareOp = description->depthCompareOp,
   };
 
   // search for vkCmdSet... function calls
@@ -1364,7 +1540,8 @@ void CreatePipeline() {
 
   VkGraphicsPipelineCreateInfo pipelineInfo = {
       .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-      .stageCount = sizeof(shaderStages) / sizeof(VkPipelineShaderStageCreateInfo),
+      // the vertex stage comes first
+      .stageCount = description->depthOnly ? 1 : sizeof(shaderStages) / sizeof(VkPipelineShaderStageCreateInfo),
       .pStages = shaderStages,
       .pVertexInputState = &vertexInput,
       .pInputAssemblyState = &inputAssembly,
@@ -1380,11 +1557,55 @@ void CreatePipeline() {
       .basePipelineHandle = VK_NULL_HANDLE,
   };
 
-  err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline);
-  handleError();
+  result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, pipeline);
 
+  free(bindingDescriptions);
+  free(attributeDescriptions);
   vkDestroyShaderModule(device, fragShaderModule, nullptr);
   vkDestroyShaderModule(device, vertShaderModule, nullptr);
+  return result;
+}
+
+void CreatePipeline() {
+  // Shaders
+  gchar *vertShaderCode;
+  gchar *fragShaderCode;
+  gsize lenVertShaderCode;
+  gsize lenFragShaderCode;
+  if (!readFile("shaders/vert.spv", &vertShaderCode, &lenVertShaderCode)) {
+    err = VKT_ERROR_NO_VERT_SHADER;
+    handleError();
+  }
+  if (!readFile("shaders/frag.spv", &fragShaderCode, &lenFragShaderCode)) {
+    err = VKT_ERROR_NO_FRAG_SHADER;
+    handleError();
+  }
+
+  debugPrint("Code size vertex   shader: %5lu, divisible by 4: %s\n", lenVertShaderCode, lenVertShaderCode % 4 ? "false" : "true");
+  debugPrint("Code size fragment shader: %5lu, divisible by 4: %s\n", lenFragShaderCode, lenFragShaderCode % 4 ? "false" : "true");
+
+  // per draw data, only read by the shaders with --push-constants
+  VkPushConstantRange pushConstantRange = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = sizeof(PushConstants),
+  };
+
+  // uniform variables (see CreateDescriptorSetLayout(…))
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &descriptorSetLayout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &pushConstantRange,
+  };
+
+  err = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+  handleError();
+
+  ShaderCode *code = g_new(ShaderCode, 1);
+  *code = (ShaderCode){vertShaderCode, lenVertShaderCode, fragShaderCode, lenFragShaderCode};
+  CompilePipelineVariants(code);
 }
 
 void CreateFramebuffers() {
@@ -1410,28 +1631,46 @@ void CreateFramebuffers() {
 void CreateCommandPool() {
   VkCommandPoolCreateInfo poolInfo = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-      .queueFamilyIndex = fstGraphicsQueueFamilyIndex(),
+      .queueFamilyIndex = graphicsQueueFamily,
       .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
   };
 
   err = vkCreateCommandPool(device, &poolInfo, nullptr, &cmdPool);
   handleError();
+
+  transferCmdPool = cmdPool;
+  if (transferQueueFamily != graphicsQueueFamily) {
+    VkCommandPoolCreateInfo transferPoolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .queueFamilyIndex = transferQueueFamily,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+    };
+    err = vkCreateCommandPool(device, &transferPoolInfo, nullptr, &transferCmdPool);
+    handleError();
+  }
 }
 
 void CreateCommandBuffers() {
-  cmdBuffers = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkCommandBuffer));
+  cmdBuffers = malloc(framesInFlight * sizeof(VkCommandBuffer));
 
   VkCommandBufferAllocateInfo cmdBufferInfo = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .commandPool = cmdPool,
       .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = (uint32_t)MAX_FRAMES_IN_FLIGHT,
+      .commandBufferCount = framesInFlight,
   };
 
   err = vkAllocateCommandBuffers(device, &cmdBufferInfo, cmdBuffers);
   handleError();
 }
 
+static void drawMesh(VkCommandBuffer cmdBuffer) {
+  for (uint32_t i = 0; i < mesh->numSubmeshes; i++) {
+    const Submesh *submesh = &mesh->submeshes[i];
+    vkCmdDrawIndexed(cmdBuffer, submesh->indexCount, options.instances, submesh->firstIndex, submesh->vertexOffset, 0);
+  }
+}
+
 // vkCmd...s
 void RecordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
   VkCommandBufferBeginInfo cmdBufferBeginInfo = {
@@ -1441,6 +1680,8 @@ void RecordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
 
   err = vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo);
   handleError();
+  ResetTimestampQueries(cmdBuffer);
+  ResetPipelineStatisticsQuery(cmdBuffer);
 
   // search for 'VkAttachmentDescription attachments'
   VkClearValue clearValues[] = {
@@ -1458,11 +1699,9 @@ void RecordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
       .pClearValues = clearValues,
   };
 
+  BeginGpuPass(cmdBuffer, GPU_PASS_RENDER);
   vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-  // we could have several pipelines
-  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
   // viewport was defined to be dynamic
   // search for "VkDynamicState"
   VkViewport viewport = {
@@ -1483,22 +1722,64 @@ void RecordCommandBuffer(VkCommandBuffer cmdBuffer, uint32_t imageIndex) {
   };
   vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
-  VkBuffer vertexBuffers[] = {vertexBuffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(cmdBuffer, 0, 1, vertexBuffers, offsets);
-  vkCmdBindIndexBuffer(cmdBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-  vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-  vkCmdDrawIndexed(cmdBuffer, numIndices, 1, 0, 0, 0);
+  // only cleared while the model is loading
+  if (mesh) {
+    VkBuffer vertexBuffers[] = {vertexBuffer};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(cmdBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(cmdBuffer, indexBuffer, 0, mesh->indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+    if (options.pushConstants) {
+      // all variants share the layout, so the push constants stay valid across pipeline binds
+      vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants), &pushConstants);
+    }
+    // wireframe and debug coloring take precedence over the depth prepass
+    if (options.wireframe) {
+      vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GetPipelineVariant(PIPELINE_WIREFRAME));
+    } else if (options.debugNormals) {
+      vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GetPipelineVariant(PIPELINE_DEBUG_NORMALS));
+    } else if (options.depthPrepass) {
+      // the depth prepass writes the nearest depths, the shading pass only passes the equal test for visible fragments
+      vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GetPipelineVariant(PIPELINE_DEPTH_PREPASS));
+      drawMesh(cmdBuffer);
+      vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GetPipelineVariant(PIPELINE_DEPTH_EQUAL));
+    } else {
+      vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GetPipelineVariant(PIPELINE_DEFAULT));
+    }
+    // only the shading pass is counted, so the statistics compare with and without the depth prepass
+    BeginPipelineStatistics(cmdBuffer);
+    drawMesh(cmdBuffer);
+    EndPipelineStatistics(cmdBuffer);
+  }
   vkCmdEndRenderPass(cmdBuffer);
+  EndGpuPass(cmdBuffer, GPU_PASS_RENDER);
+  if (options.headless) {
+    BeginGpuPass(cmdBuffer, GPU_PASS_READBACK);
+    RecordReadback(cmdBuffer, imageIndex);
+    EndGpuPass(cmdBuffer, GPU_PASS_READBACK);
+  }
 
   err = vkEndCommandBuffer(cmdBuffer);
   handleError();
 }
 
+// One per swap chain image: a present waits on the semaphore, which the in flight fence of the frame doesn't cover, so
+// it's only signaled again once the image was acquired again. Recreated with the swap chain (see RecreateSwapChain()).
+static void createRenderFinishedSemaphores() {
+  semaphoresFinishedRendering = malloc(swapChainImagesCount * sizeof(VkSemaphore));
+  VkSemaphoreCreateInfo semaphoreInfo = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+  for (int i = 0; i < swapChainImagesCount; i++) {
+    err = vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphoresFinishedRendering[i]);
+    handleError();
+  }
+}
+
 void CreateSyncObjects() {
-  semaphoresImageAvailable = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkSemaphore));
-  semaphoresFinishedRendering = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkSemaphore));
-  inFlightFences = malloc(MAX_FRAMES_IN_FLIGHT * sizeof(VkFence));
+  createRenderFinishedSemaphores();
+  semaphoresImageAvailable = malloc(framesInFlight * sizeof(VkSemaphore));
+  inFlightFences = malloc(framesInFlight * sizeof(VkFence));
 
   VkSemaphoreCreateInfo semaphoreInfo = {
       .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
@@ -1510,9 +1791,8 @@ void CreateSyncObjects() {
   };
 
   err = VK_SUCCESS;
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (int i = 0; i < framesInFlight; i++) {
     err |= vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphoresImageAvailable[i]);
-    err |= vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphoresFinishedRendering[i]);
     err |= vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]);
     handleError();
   }
@@ -1521,14 +1801,20 @@ void CreateSyncObjects() {
 void CleanupSwapChain() {
   vkDestroyImageView(device, depthImageView, nullptr);
   vkDestroyImage(device, depthImage, nullptr);
-  vkFreeMemory(device, depthImageMemory, nullptr);
+  FreeMemory(&depthImageMemory);
   for (int i = 0; i < swapChainImagesCount; i++) {
     vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
   }
   for (int i = 0; i < swapChainImagesCount; i++) {
     vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+    vkDestroySemaphore(device, semaphoresFinishedRendering[i], nullptr);
+  }
+  free(semaphoresFinishedRendering);
+  if (options.headless) {
+    DestroyOffscreenImages();
+  } else {
+    vkDestroySwapchainKHR(device, swapChain, nullptr);
   }
-  vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
 void RecreateSwapChain() {
@@ -1538,10 +1824,12 @@ void RecreateSwapChain() {
   CreateImageViews();
   CreateDepthResources();
   CreateFramebuffers();
+  createRenderFinishedSemaphores();
 }
 
 void UpdateUniformBuffer(uint32_t currentImage) {
-  double elapsedTime = glfwGetTime();
+  // headless frames are animated at a fixed rate, so they are reproducible
+  double elapsedTime = options.headless ? headlessFrame / 60.0 : glfwGetTime();
   debugPrint("Elapsed time = %f seconds\r", elapsedTime);
 
   // uniform buffer object
@@ -1554,6 +1842,9 @@ void UpdateUniformBuffer(uint32_t currentImage) {
   glm_mat4_identity(model);
   vec3 v1 = {0.0f, 0.0f, 1.0f};
   glm_rotate(model, elapsedTime * glm_rad(90.0f / 2.0f), v1);
+  if (mesh && mesh->vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+    glm_mat4_mul(model, mesh->dequantizeMatrix, model);
+  }
 
   // ==== //
   // view //
@@ -1578,21 +1869,51 @@ void UpdateUniformBuffer(uint32_t currentImage) {
   glm_mat4_copy(view, ubo.view);
   glm_mat4_copy(proj, ubo.proj);
 
-  memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+  if (!options.pushConstants) {
+    memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    return;
+  }
+  // the model matrix is per draw data, the uniform buffer only gets the per frame camera
+  mat4 viewProj;
+  glm_mat4_mul(proj, view, viewProj);
+  uint32_t columns = instanceColumns();
+  if (columns) {
+    // same grid as the uniform buffer path of the shader: scaled down copies, offset in the xy plane
+    mat4 scale;
+    glm_scale_make(scale, (vec3){1.0f / columns, 1.0f / columns, 1.0f / columns});
+    glm_mat4_mul(scale, model, model);
+    glm_vec4_scale(viewProj[0], 2.0f / columns, pushConstants.instanceStepX);
+    glm_vec4_scale(viewProj[1], 2.0f / columns, pushConstants.instanceStepY);
+  }
+  glm_mat4_mul(viewProj, model, pushConstants.mvp);
+  size_t offset = offsetof(UniformBufferObject, view);
+  memcpy((char *)uniformBuffersMapped[currentImage] + offset, (char *)&ubo + offset, sizeof(ubo) - offset);
 }
 
 void drawFrame() {
   // wait for the previous frame to finish
   err = vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
   handleError();
-  // acquire an image from the swap chain
-  uint32_t imageIndex;
-  err = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, semaphoresImageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
-  if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
-    RecreateSwapChain();
-    return;
+  // GPU timings of the frame previously rendered in this slot
+  ReadTimestampQueries(currentFrame);
+  ReadPipelineStatisticsQuery(currentFrame);
+  // pipelines rebuilt by the shader watcher are swapped in before recording
+  SwapInReloadedPipeline();
+  // swap in meshes finished by the loader thread (before the fence is reset, see SwapInMesh)
+  Mesh *loadedMesh;
+  while ((loadedMesh = PollLoadedMesh())) {
+    SwapInMesh(loadedMesh);
+  }
+  // acquire an image from the swap chain, offscreen images belong to a frame in flight
+  uint32_t imageIndex = currentFrame;
+  if (!options.headless) {
+    err = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, semaphoresImageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    if (err == VK_ERROR_OUT_OF_DATE_KHR || err == VK_SUBOPTIMAL_KHR) {
+      RecreateSwapChain();
+      return;
+    }
+    handleError();
   }
-  handleError();
 
   UpdateUniformBuffer(currentFrame);
 
@@ -1605,15 +1926,15 @@ void drawFrame() {
   RecordCommandBuffer(cmdBuffers[currentFrame], imageIndex);
 
   VkSemaphore semaphoresWait[] = {semaphoresImageAvailable[currentFrame]};
-  VkSemaphore semaphoresSignal[] = {semaphoresFinishedRendering[currentFrame]};
+  VkSemaphore semaphoresSignal[] = {semaphoresFinishedRendering[imageIndex]};
 
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
   VkSubmitInfo submitInfo = {
       .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-      .waitSemaphoreCount = 1,
+      .waitSemaphoreCount = options.headless ? 0 : 1,
       .pWaitSemaphores = semaphoresWait,
-      .signalSemaphoreCount = 1,
+      .signalSemaphoreCount = options.headless ? 0 : 1,
       .pSignalSemaphores = semaphoresSignal, // will be signaled once the command buffers finished executing
       .pWaitDstStageMask = waitStages,
       .commandBufferCount = 1,
@@ -1623,6 +1944,12 @@ void drawFrame() {
   // submit recorded command buffer and return acquired image to swap chain
   err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]);
   handleError();
+  submittedFrames++;
+  if (options.headless) {
+    currentFrame = (currentFrame + 1) % framesInFlight;
+    UpdateFrameStats();
+    return;
+  }
 
   VkSwapchainKHR swapChains[] = {swapChain};
   VkPresentInfoKHR presentInfo = {
@@ -1641,16 +1968,17 @@ void drawFrame() {
   } else if (err) {
     handleError();
   }
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  currentFrame = (currentFrame + 1) % framesInFlight;
+  UpdateFrameStats();
 }
 
 void DeviceWaitIdle() { vkDeviceWaitIdle(device); };
 
-VkCommandBuffer beginSingleTimeCommands() {
+VkCommandBuffer beginSingleTimeCommands(VkCommandPool pool) {
   VkCommandBufferAllocateInfo cmdBufferInfo = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandPool = cmdPool,
+      .commandPool = pool,
       .commandBufferCount = 1,
   };
 
@@ -1669,82 +1997,46 @@ VkCommandBuffer beginSingleTimeCommands() {
   return cmdBuffer;
 }
 
-void endSingleTimeCommands(VkCommandBuffer cmdBuffer) {
-  err = vkEndCommandBuffer(cmdBuffer);
-  handleError();
-
-  VkSubmitInfo submitInfo = {
-      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-      .commandBufferCount = 1,
-      .pCommandBuffers = &cmdBuffer,
-  };
-
-  // every graphics queue is able to transfer data (in the Vulkan specification)
-  err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-  handleError();
-  err = vkQueueWaitIdle(graphicsQueue);
-  handleError();
-
-  vkFreeCommandBuffers(device, cmdPool, 1, &cmdBuffer);
-}
-
-void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  VkCommandBuffer cmdBuffer = beginSingleTimeCommands();
-
-  VkBufferCopy copyRegion = {
-      .size = size,
-  };
-  vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  endSingleTimeCommands(cmdBuffer);
-}
-
-void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-  VkCommandBuffer cmdBuffer = beginSingleTimeCommands();
-
-  VkBufferImageCopy region = {
-      .bufferOffset = 0,
-      .bufferRowLength = 0,
-      .bufferImageHeight = 0,
-      .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-      .imageSubresource.mipLevel = 0,
-      .imageSubresource.baseArrayLayer = 0,
-      .imageSubresource.layerCount = 1,
-      .imageOffset = {0, 0, 0},
-      .imageExtent = {width, height, 1},
-  };
-
-  vkCmdCopyBufferToImage(cmdBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  endSingleTimeCommands(cmdBuffer);
-}
-
 void cleanupVulkan() {
 
   // ==============================
   // Destroy device specific items.
   // ==============================
 
+  StopModelLoader();
+  StopShaderWatcher();
+  DestroyStagingRing();
   CleanupSwapChain();
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    vkDestroySemaphore(device, semaphoresFinishedRendering[i], nullptr);
+  DestroyTimestampQueries();
+  DestroyPipelineStatisticsQueries();
+  for (int i = 0; i < framesInFlight; i++) {
     vkDestroySemaphore(device, semaphoresImageAvailable[i], nullptr);
     vkDestroyFence(device, inFlightFences[i], nullptr);
   }
+  free(semaphoresImageAvailable);
+  free(inFlightFences);
+  free(cmdBuffers);
+  if (transferCmdPool != cmdPool) {
+    vkDestroyCommandPool(device, transferCmdPool, nullptr);
+  }
   vkDestroyCommandPool(device, cmdPool, nullptr);
-  vkDestroyPipeline(device, graphicsPipeline, nullptr);
+  DestroyPipelineVariants();
+  SavePipelineCache();
+  DestroyPipelineCache();
   vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
   vkDestroyRenderPass(device, renderPass, nullptr);
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = 0; i < framesInFlight; i++) {
     vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-    vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+    FreeMemory(&uniformBuffersMemory[i]);
   }
+  free(uniformBuffers);
+  free(uniformBuffersMemory);
+  free(uniformBuffersMapped);
+  free(descriptorSets);
   vkDestroyDescriptorPool(device, descriptorPool, nullptr);
   vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-  vkDestroyBuffer(device, indexBuffer, nullptr);
-  vkFreeMemory(device, indexBufferMemory, nullptr);
-  vkDestroyBuffer(device, vertexBuffer, nullptr);
-  vkFreeMemory(device, vertexBufferMemory, nullptr);
+  destroyMeshBuffers();
+  DestroyMemoryAllocator();
   vkDestroyDevice(device, nullptr);
 
   // ================================
@@ -1754,17 +2046,29 @@ void cleanupVulkan() {
   if (enableValidationLayers) {
     DestroyDebugUtilsMessenger(instance, debugMessenger, nullptr);
   }
-  vkDestroySurfaceKHR(instance, surface, nullptr);
+  // no surface extensions are enabled without a window
+  if (!options.headless) {
+    vkDestroySurfaceKHR(instance, surface, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
 bool hasStencilComponent(VkFormat format) { return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT; }
 
 void initVulkan() {
+  framesInFlight = options.framesInFlight;
+  debugPrint("Frames in flight: %u\n", framesInFlight);
+  if (options.headless) {
+    // no swap chain without a surface
+    requiredDeviceExtensionsCount = 0;
+  }
   CreateInstance();
   SetupDebugMessenger();
-  CreateSurface();
+  if (!options.headless) {
+    CreateSurface();
+  }
   PickPhysicalDevice();
+  InitMemoryTypes();
   PrintQueueFamilies();
   CreateLogicalDevice();
   CreateSwapChain();
@@ -1773,14 +2077,25 @@ void initVulkan() {
   CreateDepthResources();
   CreateFramebuffers();
   CreateDescriptorSetLayout();
+  // loaded models are converted into the pipeline's vertex input
+  vertexFormat = RequestedVertexFormat();
+  CreatePipelineCache();
   CreatePipeline();
+  StartShaderWatcher();
   CreateCommandPool();
-  LoadModel();
-  CreateVertexBuffer();
-  CreateIndexBuffer();
+  CreateStagingRing();
+  // the model is uploaded by drawFrame() once it's loaded, the benchmark loads its models itself
+  const char *model = g_getenv("VKT_MODEL");
+  const char *models[] = {model ? model : "models/cube.obj", nullptr};
+  if (!options.benchmark) {
+    StartModelLoader(models);
+  }
   CreateUniformBuffers();
   CreateDescriptorPool();
   CreateDescriptorSets();
   CreateCommandBuffers();
+  CreateTimestampQueries();
+  CreatePipelineStatisticsQueries();
   CreateSyncObjects();
+  PrintMemoryStats();
 }
@@ -2,10 +2,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// window size
-const uint32_t WIDTH = 800;
-const uint32_t HEIGHT = 600;
-
 extern const bool enableValidationLayers;
 extern VkResult err;
 extern VkInstance instance;
@@ -21,6 +17,16 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
   if ((key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q) && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GLFW_TRUE);
   }
+  // pipeline variants which weren't compiled at launch are built on first use (see src/pipelines.c)
+  if (key == GLFW_KEY_W && action == GLFW_PRESS) {
+    options.wireframe = !options.wireframe;
+  }
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    options.depthPrepass = !options.depthPrepass;
+  }
+  if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+    options.debugNormals = !options.debugNormals;
+  }
 }
 
 void initGLFW() {
@@ -35,7 +41,7 @@ void initGLFW() {
   // use Vullkan API (not OpenGL)
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
   // create window
-  window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Tutorial", nullptr, nullptr);
+  window = glfwCreateWindow(options.width, options.height, "Vulkan Tutorial", nullptr, nullptr);
   if (!window) {
     glfwTerminate();
     exit(EXIT_FAILURE);
@@ -46,9 +52,12 @@ void initGLFW() {
 }
 
 const char **getRequiredExtensions(uint32_t *requiredExtensionsCount) {
-  // get required GLFW extensions
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(requiredExtensionsCount);
+  // get required GLFW extensions (none without a window)
+  const char **glfwExtensions = nullptr;
+  *requiredExtensionsCount = 0;
+  if (!options.headless) {
+    glfwExtensions = glfwGetRequiredInstanceExtensions(requiredExtensionsCount);
+  }
 
   // print GLFW extensions
   debugPrint("GLFW:\n");